@@ -31,7 +31,9 @@ struct _OsAnimationPrivate {
   OsAnimationUpdateFunc update_func;
   gint64 start_time;
   gint64 duration;
+  gint64 pause_time;
   gint32 rate;
+  gboolean paused;
   gpointer user_data;
   guint32 source_id;
 };
@@ -141,7 +143,7 @@ os_animation_is_running (OsAnimation *animation)
 
   priv = animation->priv;
 
-  return priv->source_id != 0;
+  return priv->source_id != 0 || priv->paused;
 }
 
 /**
@@ -165,6 +167,32 @@ os_animation_set_duration (OsAnimation *animation,
   priv->duration = (gint64) duration * G_GINT64_CONSTANT (1000);
 }
 
+/**
+ * os_animation_extend:
+ * @animation: a #OsAnimation
+ * @duration: the duration left
+ *
+ * Extends the running animation so that it ends
+ * after @duration, without restarting it
+ **/
+void
+os_animation_extend (OsAnimation *animation,
+                     gint32       duration)
+{
+  OsAnimationPrivate *priv;
+  gint64 current_time;
+
+  g_return_if_fail (animation != NULL);
+  g_return_if_fail (duration != 0);
+
+  priv = animation->priv;
+
+  current_time = priv->paused ? priv->pause_time : g_get_monotonic_time ();
+
+  priv->duration = current_time - priv->start_time +
+                   (gint64) duration * G_GINT64_CONSTANT (1000);
+}
+
 /* Callback called by the animation. */
 static gboolean
 update_cb (gpointer user_data)
@@ -212,13 +240,64 @@ os_animation_start (OsAnimation *animation)
 
   priv = animation->priv;
 
-  if (priv->source_id == 0)
+  if (priv->source_id == 0 && !priv->paused)
     {
       priv->start_time = g_get_monotonic_time ();
       priv->source_id = g_timeout_add (priv->rate, update_cb, animation);
     }
 }
 
+/**
+ * os_animation_pause:
+ * @animation: a #OsAnimation
+ *
+ * Pauses the animation, if it's running.
+ * The animation is still considered running.
+ **/
+void
+os_animation_pause (OsAnimation *animation)
+{
+  OsAnimationPrivate *priv;
+
+  g_return_if_fail (animation != NULL);
+
+  priv = animation->priv;
+
+  if (priv->source_id != 0)
+    {
+      g_source_remove (priv->source_id);
+      priv->source_id = 0;
+
+      priv->pause_time = g_get_monotonic_time ();
+      priv->paused = TRUE;
+    }
+}
+
+/**
+ * os_animation_resume:
+ * @animation: a #OsAnimation
+ *
+ * Resumes the animation, if it's paused,
+ * from the weight it had when paused.
+ **/
+void
+os_animation_resume (OsAnimation *animation)
+{
+  OsAnimationPrivate *priv;
+
+  g_return_if_fail (animation != NULL);
+
+  priv = animation->priv;
+
+  if (priv->paused)
+    {
+      priv->start_time += g_get_monotonic_time () - priv->pause_time;
+      priv->paused = FALSE;
+
+      priv->source_id = g_timeout_add (priv->rate, update_cb, animation);
+    }
+}
+
 /**
  * os_animation_stop:
  * @animation: a #OsAnimation
@@ -238,14 +317,19 @@ os_animation_stop (OsAnimation        *animation,
 
   priv = animation->priv;
 
-  if (priv->source_id != 0)
+  if (priv->source_id != 0 || priv->paused)
     {
       if (stop_func != NULL)
         stop_func (priv->user_data);
       else if (priv->end_func != NULL)
         priv->end_func (priv->user_data);
 
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
+      if (priv->source_id != 0)
+        {
+          g_source_remove (priv->source_id);
+          priv->source_id = 0;
+        }
+
+      priv->paused = FALSE;
     }
 }
@@ -687,6 +687,36 @@ os_bar_set_parent (OsBar     *bar,
     }
 }
 
+/**
+ * os_bar_set_suspended:
+ * @bar: a #OsBar
+ * @suspended: whether the bar is suspended or not
+ *
+ * Pauses the animations of @bar while it can't be seen,
+ * or resumes them.
+ **/
+void
+os_bar_set_suspended (OsBar   *bar,
+                      gboolean suspended)
+{
+  OsBarPrivate *priv;
+
+  g_return_if_fail (OS_IS_BAR (bar));
+
+  priv = bar->priv;
+
+  if (suspended)
+    {
+      os_animation_pause (priv->state_animation);
+      os_animation_pause (priv->tail_animation);
+    }
+  else
+    {
+      os_animation_resume (priv->state_animation);
+      os_animation_resume (priv->tail_animation);
+    }
+}
+
 /**
  * os_bar_show:
  * @bar: a #OsBar
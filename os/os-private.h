@@ -156,6 +156,13 @@ gboolean     os_animation_is_running   (OsAnimation *animation);
 void         os_animation_set_duration (OsAnimation *animation,
                                         gint32       duration);
 
+void         os_animation_extend       (OsAnimation *animation,
+                                        gint32       duration);
+
+void         os_animation_pause        (OsAnimation *animation);
+
+void         os_animation_resume       (OsAnimation *animation);
+
 void         os_animation_start        (OsAnimation *animation);
 
 void         os_animation_stop         (OsAnimation        *animation,
@@ -203,6 +210,9 @@ void   os_bar_set_detached  (OsBar   *bar,
 void   os_bar_set_parent    (OsBar     *bar,
                              GtkWidget *parent);
 
+void   os_bar_set_suspended (OsBar   *bar,
+                             gboolean suspended);
+
 void   os_bar_show          (OsBar *bar);
 
 void   os_bar_size_allocate (OsBar       *bar,
@@ -235,6 +245,14 @@ GType      os_thumb_get_type     (void) G_GNUC_CONST;
 
 GtkWidget* os_thumb_new          (GtkOrientation orientation);
 
+void       os_thumb_get_position (OsThumb *thumb,
+                                  gint    *x,
+                                  gint    *y);
+
+void       os_thumb_move         (OsThumb *thumb,
+                                  gint     x,
+                                  gint     y);
+
 void       os_thumb_resize       (OsThumb *thumb,
                                   gint     width,
                                   gint     height);
@@ -242,6 +260,33 @@ void       os_thumb_resize       (OsThumb *thumb,
 void       os_thumb_set_detached (OsThumb *thumb,
                                   gboolean detached);
 
+/* os-timer.c */
+
+typedef void (*OsTimerFunc) (gpointer user_data);
+
+typedef struct _OsTimer OsTimer;
+
+/* One-shot timer embedded in its owner, scheduled on a timer wheel
+ * shared by the whole process and driven by a single main loop source. */
+struct _OsTimer {
+  GList link;
+  GQueue *slot;
+  OsTimerFunc func;
+  gpointer user_data;
+  gint64 expire_tick;
+};
+
+void     os_timer_init       (OsTimer    *timer,
+                              OsTimerFunc func,
+                              gpointer    user_data);
+
+void     os_timer_schedule   (OsTimer *timer,
+                              guint    timeout);
+
+void     os_timer_cancel     (OsTimer *timer);
+
+gboolean os_timer_is_pending (OsTimer *timer);
+
 G_END_DECLS
 
 #ifdef __GNUC__
@@ -28,10 +28,13 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gdk/gdkx.h>
 #include <X11/Xatom.h>
+#include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XInput2.h>
+#include <xcb/xcb.h>
 
 /* Size of the bar in pixels. */
 #define BAR_SIZE 3
@@ -45,6 +48,13 @@
 /* Min duration of the scrolling. */
 #define MIN_DURATION_SCROLLING 250
 
+/* Duration of the scrolling of the mouse wheel. */
+#define DURATION_WHEEL 150
+
+/* Acceleration added by each wheel event of a burst, and its max. */
+#define WHEEL_ACCELERATION_STEP 0.25
+#define MAX_WHEEL_ACCELERATION 4.0
+
 /* Modifier key used to slow down actions. */
 #define MODIFIER_KEY GDK_CONTROL_MASK
 
@@ -63,6 +73,25 @@
 /* Timeout before hiding in ms, after leaving the toplevel. */
 #define TIMEOUT_TOPLEVEL_HIDE 200
 
+/* Max interval in ms between the wheel events of a burst. */
+#define TIMEOUT_WHEEL_BURST 80
+
+/* Interval in ms between the motions handled in the proximity,
+ * about once per frame of a 60 Hz display. */
+#define RATE_MOTION 16
+
+/* Interval in ms between the adjustment updates of a thumb drag. */
+#define RATE_DRAG 16
+
+/* Interval in ms between the deliveries of the wheel deltas. */
+#define RATE_WHEEL 16
+
+/* Size in pixels of the cells of the proximity grid. */
+#define PROXIMITY_CELL_SIZE 64
+
+/* Time budget in us of a slice of the scrollbar mode switch. */
+#define MODE_SWITCH_SLICE_BUDGET 8000
+
 typedef enum {
   OS_SCROLL_PAGE,
   OS_SCROLL_STEP
@@ -99,10 +128,140 @@ typedef enum
 
 typedef struct
 {
+  GdkRectangle geometry;
+  gint x1; /* Left edge of the monitor, past the struts. */
+  gint x2; /* Right edge of the monitor, before the struts. */
+  gint y1; /* Top edge of the monitor, past the struts. */
+  gint y2; /* Bottom edge of the monitor, before the struts. */
+} OsMonitor;
+
+typedef struct
+{
+  GdkRectangle handle; /* Handle of the paned, relative to the toplevel. */
+  OsCoordinate thumb; /* Thumb, relative to the toplevel. */
+  OsSide side;
+  gint toplevel_width;
+  gint toplevel_height;
+  gboolean valid;
+} OsResizeGeometry;
+
+typedef struct
+{
+  gulong *values; /* Rectangles of _UNITY_NET_WORKAREA_REGION. */
+  gulong n_values;
+} OsWorkareaSnapshot;
+
+typedef enum
+{
+  OS_UPDATE_NONE = 0, /* Nothing to update. */
+  OS_UPDATE_CHANGED = 1, /* The adjustment changed, update size and visibility. */
+  OS_UPDATE_VALUE = 2, /* The adjustment value changed, update the position. */
+  OS_UPDATE_LAYOUT = 4 /* The toplevel was resized or the bar wasn't moved, update the layout. */
+} OsUpdateFlags;
+
+typedef struct
+{
+  gdouble lower;
+  gdouble upper;
+  gdouble page_size;
+  gdouble value;
+  gint min_slider_size;
+  gint slider_length;
+  gint trough_length;
+  GtkOrientation orientation;
+  gboolean valid;
+} OsLayout;
+
+typedef struct
+{
+  GdkRectangle cells; /* Cells of the proximity grid covered by the scrollbar. */
   gboolean proximity;
   gboolean running;
+  gboolean tracking; /* In the list of scrollbars tracking the motion. */
+  guint serial; /* Serial of the last motion dispatched. */
 } OsWindowFilter;
 
+typedef struct
+{
+  GList link; /* Link in the queue, its data is the scrollbar. */
+  GQueue *queue; /* Queue holding the link, NULL if unlinked. */
+} OsRegistryLink;
+
+typedef struct
+{
+  GQueue scrollbars; /* Realized scrollbars inside the toplevel. */
+  GtkWindowGroup *window_group; /* Group shared by the thumbs, see join_window_group (). */
+  guint window_group_users; /* Scrollbars holding a reference to the group. */
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+  gboolean mapped;
+  gboolean obscured; /* Fully obscured by other windows. */
+  gboolean suspended; /* Not viewable, the scrollbars are suspended. */
+  gboolean valid; /* The origin is up to date. */
+} OsToplevel;
+
+typedef struct
+{
+  GHashTable *grid; /* Scrollbars in each cell of the proximity grid. */
+  GQueue scrollbars; /* Scrollbars inside the window. */
+  GSList *tracking; /* Scrollbars tracking the motion outside the proximity. */
+  OsCoordinate motion; /* Latest pointer position, not handled yet. */
+  gboolean motion_pending;
+  guint serial;
+  guint32 source_motion_id;
+} OsWindowDispatcher;
+
+typedef struct
+{
+  gdouble value; /* Latest value of the drag, not applied yet. */
+  gboolean pending;
+  guint32 source_id;
+} OsDrag;
+
+typedef struct
+{
+  gdouble delta; /* Wheel delta accumulated, not delivered yet. */
+  gdouble acceleration;
+  guint32 time; /* Time of the latest wheel event. */
+  guint32 source_id;
+} OsWheel;
+
+typedef struct
+{
+  Window xid_parent;
+  gboolean failed; /* The request failed, restack using _NET_RESTACK_WINDOW. */
+} OsRestackRequest;
+
+typedef struct
+{
+  GHashTable *pending; /* Realized scrollbars still in the previous mode. */
+  GSList *queue; /* Order of the switch, scrollbars of visible toplevels first. */
+  ScrollbarMode previous_mode;
+  gint64 start_time;
+  gint64 worst_slice; /* Duration in us of the longest slice. */
+  guint n_scrollbars;
+  guint n_slices;
+  guint32 source_id;
+} OsModeSwitch;
+
+typedef struct
+{
+  void (* dispose) (GObject *object);
+  gboolean (* expose_event) (GtkWidget *widget, GdkEventExpose *event);
+  void (* grab_notify) (GtkWidget *widget, gboolean was_grabbed);
+  void (* hide) (GtkWidget *widget);
+  void (* map) (GtkWidget *widget);
+  void (* realize) (GtkWidget *widget);
+  void (* show) (GtkWidget *widget);
+  void (* size_allocate) (GtkWidget *widget, GdkRectangle *allocation);
+  void (* size_request) (GtkWidget *widget, GtkRequisition *requisition);
+  void (* state_changed) (GtkWidget *widget, GtkStateType state);
+  void (* unmap) (GtkWidget *widget);
+  void (* unrealize) (GtkWidget *widget);
+} OsScrollbarVtable;
+
 typedef struct
 {
   GdkRectangle overlay;
@@ -112,50 +271,97 @@ typedef struct
   GtkAllocation thumb_all;
   GtkAdjustment *adjustment;
   GtkOrientation orientation;
-  GtkWidget *thumb;
-  GtkWindowGroup *window_group;
-  OsAnimation *animation;
+  GtkPaned *paned; /* Paned the thumb can resize, valid if paned_valid. */
+  GtkWidget *thumb; /* Created on the first proximity, see get_thumb (). */
+  GtkWindowGroup *window_group; /* Group of the toplevel, held while realized with a thumb. */
+  OsAnimation *animation; /* Created with the thumb. */
   OsBar *bar;
   OsCoordinate pointer;
   OsCoordinate thumb_win;
+  OsDrag drag;
+  OsWheel wheel;
   OsEventFlags event;
+  OsLayout layout; /* Inputs of the last layout calculated. */
+  OsRegistryLink dispatcher_link; /* Link in the scrollbars of the window dispatcher. */
+  OsRegistryLink toplevel_link; /* Link in the scrollbars of the toplevel. */
+  OsResizeGeometry resize_geometry; /* Inputs of the last resizability check. */
   OsStateFlags state;
+  OsSide paned_side; /* Side used to look up the paned. */
   OsSide side;
+  OsUpdateFlags update;
   OsWindowFilter filter;
-  gboolean active_window;
-  gboolean allow_resize;
-  gboolean allow_resize_paned;
-  gboolean resizing_paned;
-  gboolean hidable_thumb;
-  gboolean window_button_press; /* FIXME(Cimi) to replace with X11 input events. */
+  guint active_window : 1;
+  guint allow_resize : 1;
+  guint allow_resize_paned : 1;
+  guint allocation_valid : 1; /* The trough holds the last allocation. */
+  guint paned_valid : 1;
+  guint resizing_paned : 1;
+  guint suspended : 1; /* The toplevel isn't viewable, see suspend_scrollbar (). */
+  guint use_native : 1; /* The application opted out, checked at realize. */
+  guint hidable_thumb : 1;
+  guint watch_workarea : 1; /* The scrollbar is watching the workarea changes. */
+  guint window_button_press : 1; /* FIXME(Cimi) to replace with X11 input events. */
   gdouble value;
   gfloat fine_scroll_multiplier;
   gfloat slide_initial_slider_position;
   gfloat slide_initial_coordinate;
   gint64 present_time;
-  guint32 source_deactivate_bar_id;
-  guint32 source_hide_thumb_id;
-  guint32 source_show_thumb_id;
-  guint32 source_unlock_thumb_id;
+  Window restack_xid;
+  OsTimer hide_thumb_timer;
+  OsTimer show_thumb_timer;
+  OsTimer unlock_thumb_timer;
+  guint32 source_update_id;
 } OsScrollbarPrivate;
 
 static Atom net_active_window_atom = None;
+static Atom net_restack_window_atom = None;
 static Atom unity_net_workarea_region_atom = None;
-static GSList *os_root_list = NULL;
-static GSList *scrollbar_list = NULL;
+static gboolean restack_use_net_wm = FALSE;
+static guint32 source_restack_id = 0;
+static GHashTable *os_root_table = NULL; /* Scrollbars with a private struct. */
+static GHashTable *scrollbar_table = NULL; /* Realized scrollbars. */
+static GHashTable *restack_table = NULL; /* Restack requests, by thumb XID. */
+static GHashTable *restack_serials = NULL; /* Thumb XIDs, by serial of their restack request. */
+static GQuark os_quark_dispatcher = 0;
 static GQuark os_quark_placement = 0;
 static GQuark os_quark_qdata = 0;
+static GQuark os_quark_toplevel = 0;
 static ScrollbarMode scrollbar_mode = SCROLLBAR_MODE_NORMAL;
+static OsModeSwitch mode_switch;
 static cairo_region_t *os_workarea = NULL;
+static GdkWindow *os_workarea_root = NULL;
+static gboolean os_workarea_events_added = FALSE;
+static gulong *os_workarea_values = NULL;
+static gulong os_workarea_n_values = 0;
+static gboolean os_workarea_fetched = FALSE; /* The values were fetched since the workarea was created. */
+static guint os_workarea_watchers = 0;
+static gboolean os_workarea_thread = FALSE;
+static volatile gint os_workarea_thread_alive = FALSE; /* Cleared by the watcher thread on exit. */
+static volatile gpointer os_workarea_snapshot = NULL;
+static GModule *os_module = NULL;
+static guint32 source_workarea_id = 0;
+static GdkScreen *os_monitors_screen = NULL;
+static OsMonitor *os_monitors = NULL;
+static gint os_n_monitors = 0;
 
 static void adjustment_changed_cb (GtkAdjustment *adjustment, gpointer user_data);
 static void adjustment_value_changed_cb (GtkAdjustment *adjustment, gpointer user_data);
+static void cancel_drag (GtkScrollbar *scrollbar);
+static void cancel_wheel (GtkScrollbar *scrollbar);
+static void flush_drag (GtkScrollbar *scrollbar);
+static void flush_update (GtkScrollbar *scrollbar);
+static void hide_thumb_cb (gpointer user_data);
+static void queue_update (GtkScrollbar *scrollbar, OsUpdateFlags update);
 static OsScrollbarPrivate* get_private (GtkWidget *widget);
+static void join_window_group (GtkScrollbar *scrollbar);
+static void leave_window_group (GtkScrollbar *scrollbar);
 static void notify_adjustment_cb (GObject *object, gpointer user_data);
+static void hierarchy_changed_cb (GtkWidget *widget, GtkWidget *previous_toplevel, gpointer user_data);
 static void notify_orientation_cb (GObject *object, gpointer user_data);
 static GdkFilterReturn root_filter_func (GdkXEvent *gdkxevent, GdkEvent *event, gpointer user_data);
 static void scrolling_cb (gfloat weight, gpointer user_data);
 static void scrolling_end_cb (gpointer user_data);
+static void show_thumb_cb (gpointer user_data);
 static void swap_adjustment (GtkScrollbar *scrollbar, GtkAdjustment *adjustment);
 static void swap_thumb (GtkScrollbar *scrollbar, GtkWidget *thumb);
 static gboolean thumb_button_press_event_cb (GtkWidget *widget, GdkEventButton *event, gpointer user_data);
@@ -166,6 +372,8 @@ static void thumb_map_cb (GtkWidget *widget, gpointer user_data);
 static gboolean thumb_motion_notify_event_cb (GtkWidget *widget, GdkEventMotion *event, gpointer user_data);
 static gboolean thumb_scroll_event_cb (GtkWidget *widget, GdkEventScroll *event, gpointer user_data);
 static void thumb_unmap_cb (GtkWidget *widget, gpointer user_data);
+static void thumb_unrealize_cb (GtkWidget *widget, gpointer user_data);
+static void unlock_thumb_cb (gpointer user_data);
 
 /* GtkScrollbar vfunc pointers. */
 static gboolean (* pre_hijacked_scrollbar_expose_event) (GtkWidget *widget, GdkEventExpose *event);
@@ -179,6 +387,7 @@ static void (* pre_hijacked_scrollbar_show) (GtkWidget *widget);
 static void (* pre_hijacked_scrollbar_size_allocate) (GtkWidget *widget, GdkRectangle *allocation);
 static void (* pre_hijacked_scrollbar_unmap) (GtkWidget *widget);
 static void (* pre_hijacked_scrollbar_unrealize) (GtkWidget *widget);
+static int (* pre_x_error_handler) (Display *display, XErrorEvent *error);
 static void (* pre_hijacked_scrollbar_dispose) (GObject *object);
 
 /* Hijacked GtkScrollbar vfunc pointers. */
@@ -202,124 +411,132 @@ static void (* widget_class_show) (GtkWidget *widget);
 static void (* widget_class_unmap) (GtkWidget *widget);
 static void (* widget_class_unrealize) (GtkWidget *widget);
 
+/* GtkScrollbar vtables, see install_scrollbar_vtable (). */
+static OsScrollbarVtable original_vtable; /* Vfuncs of GtkScrollbar before the module. */
+static OsScrollbarVtable native_vtable; /* Native scrollbars. */
+static OsScrollbarVtable overlay_vtable; /* Overlay scrollbars. */
+static OsScrollbarVtable switch_vtable; /* Checks the mode of each scrollbar during a switch. */
+static const OsScrollbarVtable *scrollbar_vtable = &original_vtable;
+
 /* Calculate bar layout info. */
 static void
-calc_layout_bar (GtkScrollbar *scrollbar,
-                 gdouble       adjustment_value)
+calc_layout_bar (GtkScrollbar *scrollbar)
 {
+  OsLayout *layout;
   OsScrollbarPrivate *priv;
+  gdouble range;
+  gint position, length;
 
   priv = get_private (GTK_WIDGET (scrollbar));
+  layout = &priv->layout;
 
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
-    {
-      gint y, trough_length, height;
-
-      y = 0;
-      trough_length = priv->trough.height;
+  range = layout->upper - layout->lower;
+  position = 0;
 
-      if (gtk_adjustment_get_upper (priv->adjustment) - gtk_adjustment_get_lower (priv->adjustment) != 0)
-        height = (trough_length * (gtk_adjustment_get_page_size (priv->adjustment) /
-                                   (gtk_adjustment_get_upper (priv->adjustment) - 
-                                    gtk_adjustment_get_lower (priv->adjustment))));
-      else
-        height = gtk_range_get_min_slider_size (GTK_RANGE (scrollbar));
+  if (range != 0)
+    length = layout->trough_length * (layout->page_size / range);
+  else
+    length = layout->min_slider_size;
 
-      height = MAX (height, gtk_range_get_min_slider_size (GTK_RANGE (scrollbar)));
+  length = MAX (length, layout->min_slider_size);
 
-      if (gtk_adjustment_get_upper (priv->adjustment) -
-          gtk_adjustment_get_lower (priv->adjustment) -
-          gtk_adjustment_get_page_size (priv->adjustment) != 0)
-        y = (trough_length - height) * ((adjustment_value - gtk_adjustment_get_lower (priv->adjustment)) /
-                                        (gtk_adjustment_get_upper (priv->adjustment) -
-                                         gtk_adjustment_get_lower (priv->adjustment) -
-                                         gtk_adjustment_get_page_size (priv->adjustment)));
+  if (range - layout->page_size != 0)
+    position = (layout->trough_length - length) * ((layout->value - layout->lower) /
+                                                   (range - layout->page_size));
 
-      y = CLAMP (y, 0, trough_length);
+  position = CLAMP (position, 0, layout->trough_length);
 
-      priv->overlay.y = y;
-      priv->overlay.height = height;
+  if (layout->orientation == GTK_ORIENTATION_VERTICAL)
+    {
+      priv->overlay.y = position;
+      priv->overlay.height = length;
     }
   else
     {
-      gint x, trough_length, width;
+      priv->overlay.x = position;
+      priv->overlay.width = length;
+    }
+}
 
-      x = 0;
-      trough_length = priv->trough.width;
+/* Calculate slider (thumb) layout info. */
+static void
+calc_layout_slider (GtkScrollbar *scrollbar)
+{
+  OsLayout *layout;
+  OsScrollbarPrivate *priv;
+  gdouble range;
+  gint position;
 
-      if (gtk_adjustment_get_upper (priv->adjustment) - gtk_adjustment_get_lower (priv->adjustment) != 0)
-        width = (trough_length * (gtk_adjustment_get_page_size (priv->adjustment) /
-                                  (gtk_adjustment_get_upper (priv->adjustment) -
-                                   gtk_adjustment_get_lower (priv->adjustment))));
-      else
-        width =  gtk_range_get_min_slider_size (GTK_RANGE (scrollbar));
+  priv = get_private (GTK_WIDGET (scrollbar));
+  layout = &priv->layout;
 
-      width = MAX (width, gtk_range_get_min_slider_size (GTK_RANGE (scrollbar)));
+  range = layout->upper - layout->lower;
+  position = 0;
 
-      if (gtk_adjustment_get_upper (priv->adjustment) -
-          gtk_adjustment_get_lower (priv->adjustment) -
-          gtk_adjustment_get_page_size (priv->adjustment) != 0)
-        x = (trough_length - width) * ((adjustment_value - gtk_adjustment_get_lower (priv->adjustment)) /
-                                       (gtk_adjustment_get_upper (priv->adjustment) -
-                                        gtk_adjustment_get_lower (priv->adjustment) -
-                                        gtk_adjustment_get_page_size (priv->adjustment)));
+  if (range - layout->page_size != 0)
+    position = (layout->trough_length - layout->slider_length) * ((layout->value - layout->lower) /
+                                                                  (range - layout->page_size));
 
-      x = CLAMP (x, 0, trough_length);
+  position = CLAMP (position, 0, layout->trough_length);
 
-      priv->overlay.x = x;
-      priv->overlay.width = width;
-    }
+  if (layout->orientation == GTK_ORIENTATION_VERTICAL)
+    priv->slider.y = position;
+  else
+    priv->slider.x = position;
 }
 
-/* Calculate slider (thumb) layout info. */
+/* Calculate the bar and slider layout,
+ * only if its inputs changed since the last time. */
 static void
-calc_layout_slider (GtkScrollbar *scrollbar,
-                    gdouble       adjustment_value)
+calc_layout (GtkScrollbar *scrollbar,
+             gdouble       adjustment_value)
 {
+  OsLayout layout;
   OsScrollbarPrivate *priv;
+  gboolean bar_dirty, slider_dirty, common_dirty;
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
+  layout.lower = gtk_adjustment_get_lower (priv->adjustment);
+  layout.upper = gtk_adjustment_get_upper (priv->adjustment);
+  layout.page_size = gtk_adjustment_get_page_size (priv->adjustment);
+  layout.value = adjustment_value;
+  layout.orientation = priv->orientation;
+  layout.min_slider_size = gtk_range_get_min_slider_size (GTK_RANGE (scrollbar));
+
   if (priv->orientation == GTK_ORIENTATION_VERTICAL)
     {
-      gint y, trough_length, height;
-
-      y = 0;
-      trough_length = priv->trough.height;
-      height = priv->slider.height;
-
-      if (gtk_adjustment_get_upper (priv->adjustment) -
-          gtk_adjustment_get_lower (priv->adjustment) -
-          gtk_adjustment_get_page_size (priv->adjustment) != 0)
-        y = (trough_length - height) * ((adjustment_value - gtk_adjustment_get_lower (priv->adjustment)) /
-                                        (gtk_adjustment_get_upper (priv->adjustment) -
-                                         gtk_adjustment_get_lower (priv->adjustment) -
-                                         gtk_adjustment_get_page_size (priv->adjustment)));
-
-      y = CLAMP (y, 0, trough_length);
-
-      priv->slider.y = y;
+      layout.trough_length = priv->trough.height;
+      layout.slider_length = priv->slider.height;
     }
   else
     {
-      gint x, trough_length, width;
+      layout.trough_length = priv->trough.width;
+      layout.slider_length = priv->slider.width;
+    }
 
-      x = 0;
-      trough_length = priv->trough.width;
-      width = priv->slider.width;
+  layout.valid = TRUE;
 
-      if (gtk_adjustment_get_upper (priv->adjustment) -
-          gtk_adjustment_get_lower (priv->adjustment) -
-          gtk_adjustment_get_page_size (priv->adjustment) != 0)
-        x = (trough_length - width) * ((adjustment_value - gtk_adjustment_get_lower (priv->adjustment)) /
-                                       (gtk_adjustment_get_upper (priv->adjustment) -
-                                        gtk_adjustment_get_lower (priv->adjustment) -
-                                        gtk_adjustment_get_page_size (priv->adjustment)));
+  common_dirty = !priv->layout.valid ||
+                 layout.lower != priv->layout.lower ||
+                 layout.upper != priv->layout.upper ||
+                 layout.page_size != priv->layout.page_size ||
+                 layout.value != priv->layout.value ||
+                 layout.orientation != priv->layout.orientation ||
+                 layout.trough_length != priv->layout.trough_length;
+  bar_dirty = common_dirty || layout.min_slider_size != priv->layout.min_slider_size;
+  slider_dirty = common_dirty || layout.slider_length != priv->layout.slider_length;
+
+  if (!bar_dirty && !slider_dirty)
+    return;
 
-      x = CLAMP (x, 0, trough_length);
+  priv->layout = layout;
 
-      priv->slider.x = x;
-    }
+  if (bar_dirty)
+    calc_layout_bar (scrollbar);
+
+  if (slider_dirty)
+    calc_layout_slider (scrollbar);
 }
 
 /* Calculate slide_initial_slider_position with more precision. */
@@ -333,6 +550,9 @@ calc_precise_slide_values (GtkScrollbar *scrollbar,
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
+  /* Start from the latest value of the drag. */
+  flush_drag (scrollbar);
+
   adjustment_value = gtk_adjustment_get_value (priv->adjustment);
 
   if (priv->orientation == GTK_ORIENTATION_VERTICAL)
@@ -413,202 +633,832 @@ calc_precise_slide_values (GtkScrollbar *scrollbar,
     }
 }
 
-/* Calculate the workarea using _UNITY_NET_WORKAREA_REGION. */
+/* Drop the monitor table, it will be rebuilt when needed. */
 static void
-calc_workarea (Display *display,
-               Window   root)
+free_monitors (void)
 {
-  Atom type;
-  gint result, fmt;
-  gulong nitems, nleft;
-  guchar *property_data;
-  gulong *long_data;
+  g_free (os_monitors);
+  os_monitors = NULL;
+  os_n_monitors = 0;
+}
 
-  result = XGetWindowProperty (display, root,
-                               unity_net_workarea_region_atom,
-                               0L, 4096L, FALSE, XA_CARDINAL,
-                               &type, &fmt, &nitems, &nleft, &property_data);
+/* Rebuild the workarea from the rectangles of _UNITY_NET_WORKAREA_REGION,
+ * only if they changed. */
+static void
+set_workarea (const gulong *values,
+              gulong        n_values)
+{
+  guint i;
 
-  /* Clear the os_workarea region,
-   * before the union with the new rectangles.
-   * Maybe it'd be better to place this call
-   * inside the if statement below. */
-  cairo_region_subtract (os_workarea, os_workarea);
+  os_workarea_fetched = TRUE;
 
-  if (result == Success && property_data)
-    {
-      long_data = (gulong*) property_data;
+  if (n_values == os_workarea_n_values &&
+      (n_values == 0 || memcmp (values, os_workarea_values, n_values * sizeof (gulong)) == 0))
+    return;
 
-      if (fmt == 32 && type == XA_CARDINAL && nitems % 4 == 0)
-        {
-          guint count;
-          guint i;
+  g_free (os_workarea_values);
+  os_workarea_values = g_new (gulong, n_values);
+  os_workarea_n_values = n_values;
 
-          count = nitems / 4;
+  if (n_values > 0)
+    memcpy (os_workarea_values, values, n_values * sizeof (gulong));
 
-          for (i = 0; i < count; i++)
-            {
-              cairo_rectangle_int_t rect;
+  /* Clear the os_workarea region,
+   * before the union with the new rectangles. */
+  cairo_region_subtract (os_workarea, os_workarea);
 
-              rect.x = long_data[i * 4 + 0];
-              rect.y = long_data[i * 4 + 1];
-              rect.width = long_data[i * 4 + 2];
-              rect.height = long_data[i * 4 + 3];
+  for (i = 0; i < os_workarea_n_values / 4; i++)
+    {
+      cairo_rectangle_int_t rect;
 
-              cairo_region_union_rectangle (os_workarea, &rect);
-            }
-        }
+      rect.x = os_workarea_values[i * 4 + 0];
+      rect.y = os_workarea_values[i * 4 + 1];
+      rect.width = os_workarea_values[i * 4 + 2];
+      rect.height = os_workarea_values[i * 4 + 3];
+
+      cairo_region_union_rectangle (os_workarea, &rect);
     }
+
+  /* The struts changed, rebuild the monitor table when needed. */
+  free_monitors ();
 }
 
-/* Check whether the thumb movement can be considered connected or not. */
-static void
-check_connection (GtkScrollbar *scrollbar)
+/* Fetch the rectangles of _UNITY_NET_WORKAREA_REGION,
+ * a missing or malformed property means no workarea. */
+static gulong*
+get_workarea_values (Display *display,
+                     Window   root,
+                     Atom     atom,
+                     gulong  *n_values)
 {
-  OsScrollbarPrivate *priv;
-  gint x_pos, y_pos;
+  Atom type;
+  gint result, fmt;
+  gulong nitems, nleft;
+  guchar *property_data;
+  gulong *values;
 
-  priv = get_private (GTK_WIDGET (scrollbar));
+  values = NULL;
+  *n_values = 0;
 
-  /* This seems to be required to get proper values. */
-  calc_layout_bar (scrollbar, gtk_adjustment_get_value (priv->adjustment));
-  calc_layout_slider (scrollbar, gtk_adjustment_get_value (priv->adjustment));
+  result = XGetWindowProperty (display, root, atom,
+                               0L, 4096L, FALSE, XA_CARDINAL,
+                               &type, &fmt, &nitems, &nleft, &property_data);
 
-  gdk_window_get_origin (gtk_widget_get_window (priv->thumb), &x_pos, &y_pos);
+  if (result != Success || property_data == NULL)
+    return NULL;
 
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
-    {
-      if (priv->overlay.height > priv->slider.height)
-        {
-          if (y_pos >= priv->thumb_win.y + priv->overlay.y &&
-              y_pos + priv->slider.height <= priv->thumb_win.y + priv->overlay.y + priv->overlay.height)
-            priv->state |= OS_STATE_CONNECTED;
-          else
-            priv->state &= ~(OS_STATE_CONNECTED);
-        }
-      else
-        {
-          if (y_pos == priv->thumb_win.y + priv->slider.y)
-            priv->state |= OS_STATE_CONNECTED;
-          else
-            priv->state &= ~(OS_STATE_CONNECTED);
-        }
-    }
-  else
+  if (fmt == 32 && type == XA_CARDINAL && nitems % 4 == 0 && nitems > 0)
     {
-      if (priv->overlay.width > priv->slider.width)
-        {
-          if (x_pos >= priv->thumb_win.x + priv->overlay.x &&
-              x_pos + priv->slider.width <= priv->thumb_win.x + priv->overlay.x + priv->overlay.width)
-            priv->state |= OS_STATE_CONNECTED;
-          else
-            priv->state &= ~(OS_STATE_CONNECTED);
-        }
-      else
-        {
-          if (x_pos == priv->thumb_win.x + priv->slider.x)
-            priv->state |= OS_STATE_CONNECTED;
-          else
-            priv->state &= ~(OS_STATE_CONNECTED);
-        }
+      values = g_new (gulong, nitems);
+      memcpy (values, property_data, nitems * sizeof (gulong));
+      *n_values = nitems;
     }
+
+  XFree (property_data);
+
+  return values;
 }
 
-/* Convert coordinates into GtkRange values. */
-static inline gdouble
-coord_to_value (GtkScrollbar *scrollbar,
-                gfloat        coord)
+/* Calculate the workarea using _UNITY_NET_WORKAREA_REGION. */
+static void
+calc_workarea (Display *display,
+               Window   root)
 {
-  OsScrollbarPrivate *priv;
-  gdouble frac;
-  gdouble value;
-  gint    trough_length;
-  gint    slider_length;
+  gulong *values;
+  gulong n_values;
 
-  priv = get_private (GTK_WIDGET (scrollbar));
+  values = get_workarea_values (display, root, unity_net_workarea_region_atom, &n_values);
 
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
-    {
-      trough_length = priv->trough.height;
-      slider_length = MAX (priv->slider.height, priv->overlay.height);
-    }
-  else
-    {
-      trough_length = priv->trough.width;
-      slider_length = MAX (priv->slider.width, priv->overlay.width);
-    }
+  set_workarea (values, n_values);
 
-  if (trough_length == slider_length)
-    frac = 1.0;
-  else
-    frac = (MAX (0, coord) / (gdouble) (trough_length - slider_length));
+  g_free (values);
+}
 
-  value = gtk_adjustment_get_lower (priv->adjustment) + frac * (gtk_adjustment_get_upper (priv->adjustment) -
-                                                                gtk_adjustment_get_lower (priv->adjustment) -
-                                                                gtk_adjustment_get_page_size (priv->adjustment));
+/* Fetch the workarea in the main loop, out of the motion path. */
+static gboolean
+update_workarea_cb (gpointer user_data)
+{
+  GdkScreen *screen;
 
-  value = CLAMP (value,
-                 gtk_adjustment_get_lower (priv->adjustment),
-                 gtk_adjustment_get_upper (priv->adjustment) - gtk_adjustment_get_page_size (priv->adjustment));
+  screen = GDK_SCREEN (user_data);
 
-  return value;
+  calc_workarea (GDK_SCREEN_XDISPLAY (screen),
+                 GDK_WINDOW_XID (gdk_screen_get_root_window (screen)));
+
+  source_workarea_id = 0;
+
+  return FALSE;
 }
 
-/* destroy the private struct */
+/* Revalidate the workarea from an idle,
+ * keeping the last values meanwhile. */
 static void
-destroy_private (gpointer priv)
+queue_workarea_update (GdkScreen *screen)
 {
-  g_slice_free (OsScrollbarPrivate, priv);
+  if (source_workarea_id == 0)
+    source_workarea_id = g_idle_add (update_workarea_cb, screen);
 }
 
-/* Get the private struct. If there isn't one, return NULL */
-static OsScrollbarPrivate*
-lookup_private (GtkWidget *widget)
+/* Free a workarea snapshot. */
+static void
+workarea_snapshot_free (OsWorkareaSnapshot *snapshot)
 {
-  return g_object_get_qdata (G_OBJECT (widget), os_quark_qdata);
+  g_free (snapshot->values);
+  g_free (snapshot);
 }
 
-/* Get the private struct. If there isn't one, create it */
-static OsScrollbarPrivate*
-get_private (GtkWidget *widget)
+/* Publish a new workarea snapshot from the watcher thread,
+ * freeing the previous one if the main thread didn't take it. */
+static void
+publish_workarea_snapshot (OsWorkareaSnapshot *snapshot)
 {
-  OsScrollbarPrivate *priv;
+  gpointer old;
 
-  /* Fetch the private qdata struct. */
-  priv = lookup_private (widget);
+  do
+    old = g_atomic_pointer_get (&os_workarea_snapshot);
+  while (!g_atomic_pointer_compare_and_exchange (&os_workarea_snapshot, old, snapshot));
 
-  if (!priv)
-    {
-      /* The widget doesn't have an associated qdata,
-       * initialize and store it. */
-      OsScrollbarPrivate *qdata;
+  if (old != NULL)
+    workarea_snapshot_free (old);
+}
 
-      /* Describe the widget for theming. */
-      gtk_widget_set_name (widget, "OsScrollbar");
+/* Take the latest workarea snapshot, if any, from the main thread. */
+static OsWorkareaSnapshot*
+take_workarea_snapshot (void)
+{
+  gpointer snapshot;
+
+  do
+    {
+      snapshot = g_atomic_pointer_get (&os_workarea_snapshot);
+
+      if (snapshot == NULL)
+        return NULL;
+    }
+  while (!g_atomic_pointer_compare_and_exchange (&os_workarea_snapshot, snapshot, NULL));
+
+  return snapshot;
+}
+
+/* Fetch the rectangles of _UNITY_NET_WORKAREA_REGION over a XCB connection,
+ * like get_workarea_values () does with Xlib. */
+static gulong*
+get_workarea_values_xcb (xcb_connection_t *connection,
+                         xcb_window_t      root,
+                         xcb_atom_t        atom,
+                         gulong           *n_values)
+{
+  xcb_get_property_cookie_t cookie;
+  xcb_get_property_reply_t *reply;
+  const guint32 *data;
+  gulong *values;
+  gint i, nitems;
+
+  values = NULL;
+  *n_values = 0;
+
+  cookie = xcb_get_property (connection, FALSE, root, atom,
+                             XCB_ATOM_CARDINAL, 0, 4096);
+  reply = xcb_get_property_reply (connection, cookie, NULL);
+
+  if (reply == NULL)
+    return NULL;
+
+  nitems = xcb_get_property_value_length (reply) / 4;
+
+  if (reply->format == 32 && reply->type == XCB_ATOM_CARDINAL && nitems % 4 == 0 && nitems > 0)
+    {
+      data = xcb_get_property_value (reply);
+
+      values = g_new (gulong, nitems);
+      for (i = 0; i < nitems; i++)
+        values[i] = data[i];
+
+      *n_values = nitems;
+    }
+
+  free (reply);
+
+  return values;
+}
+
+/* Watcher thread, tracking the workarea over its own XCB connection.
+ * It doesn't touch Xlib, so it needs neither XInitThreads ()
+ * nor the X error handler, errors are returned as events and dropped.
+ * Root resizes (RandR) and workarea changes are coalesced,
+ * then published as a snapshot for the main thread. */
+static gpointer
+workarea_thread_func (gpointer data)
+{
+  static const gchar atom_name[] = "_UNITY_NET_WORKAREA_REGION";
+  xcb_connection_t *connection;
+  xcb_intern_atom_cookie_t atom_cookie;
+  xcb_intern_atom_reply_t *atom_reply;
+  xcb_screen_iterator_t iter;
+  xcb_window_t root;
+  xcb_atom_t atom;
+  gchar *display_name;
+  gboolean changed;
+  guint32 event_mask;
+  gint screen_number;
+
+  display_name = data;
+  connection = xcb_connect (display_name, &screen_number);
+  g_free (display_name);
+
+  if (xcb_connection_has_error (connection))
+    {
+      xcb_disconnect (connection);
+      g_atomic_int_set (&os_workarea_thread_alive, FALSE);
+      return NULL;
+    }
+
+  iter = xcb_setup_roots_iterator (xcb_get_setup (connection));
+  while (screen_number-- > 0 && iter.rem > 0)
+    xcb_screen_next (&iter);
+
+  root = iter.data->root;
+
+  atom_cookie = xcb_intern_atom (connection, FALSE, strlen (atom_name), atom_name);
+  atom_reply = xcb_intern_atom_reply (connection, atom_cookie, NULL);
+
+  if (atom_reply == NULL)
+    {
+      xcb_disconnect (connection);
+      g_atomic_int_set (&os_workarea_thread_alive, FALSE);
+      return NULL;
+    }
+
+  atom = atom_reply->atom;
+  free (atom_reply);
+
+  event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+  xcb_change_window_attributes (connection, root, XCB_CW_EVENT_MASK, &event_mask);
+
+  changed = TRUE;
+
+  while (TRUE)
+    {
+      xcb_generic_event_t *event;
+
+      if (changed)
+        {
+          OsWorkareaSnapshot *snapshot;
+
+          snapshot = g_new (OsWorkareaSnapshot, 1);
+          snapshot->values = get_workarea_values_xcb (connection, root, atom, &snapshot->n_values);
+
+          publish_workarea_snapshot (snapshot);
+
+          changed = FALSE;
+        }
+
+      /* Wait for the next change, then drain the queue,
+       * so a storm of changes results in a single fetch. */
+      event = xcb_wait_for_event (connection);
+
+      /* The connection is broken, stop watching. */
+      if (event == NULL)
+        break;
+
+      do
+        {
+          switch (event->response_type & ~0x80)
+          {
+            case XCB_PROPERTY_NOTIFY:
+              if (((xcb_property_notify_event_t*) event)->atom == atom)
+                changed = TRUE;
+              break;
+            case XCB_CONFIGURE_NOTIFY:
+              changed = TRUE;
+              break;
+            default:
+              break;
+          }
+
+          free (event);
+        }
+      while ((event = xcb_poll_for_event (connection)) != NULL);
+    }
+
+  xcb_disconnect (connection);
+
+  /* The main thread falls back to the root window filter. */
+  g_atomic_int_set (&os_workarea_thread_alive, FALSE);
+
+  return NULL;
+}
+
+/* Return TRUE if the watcher thread is tracking the workarea. */
+static gboolean
+workarea_thread_is_alive (void)
+{
+  return g_atomic_int_get (&os_workarea_thread_alive);
+}
+
+/* Start the workarea watcher thread, if enabled,
+ * return TRUE if it's tracking the workarea.
+ * It's started once, if it exits the root window filter takes over. */
+static gboolean
+start_workarea_thread (GdkScreen *screen)
+{
+  GThread *thread;
+  const gchar *flag;
+  gchar *display_name;
+
+  if (os_workarea_thread)
+    return workarea_thread_is_alive ();
+
+  flag = g_getenv ("LIBOVERLAY_SCROLLBAR_WATCHER");
+
+  if (flag == NULL || *flag == '\0' || *flag == '0')
+    return FALSE;
+
+  display_name = gdk_screen_make_display_name (screen);
+
+  /* Set before the thread runs, it might exit right away. */
+  g_atomic_int_set (&os_workarea_thread_alive, TRUE);
+
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  thread = g_thread_try_new ("os-workarea", workarea_thread_func, display_name, NULL);
+
+  /* The thread is never joined. */
+  if (thread != NULL)
+    g_thread_unref (thread);
+#else
+  thread = g_thread_create (workarea_thread_func, display_name, FALSE, NULL);
+#endif
+
+  if (thread == NULL)
+    {
+      g_atomic_int_set (&os_workarea_thread_alive, FALSE);
+      g_free (display_name);
+      return FALSE;
+    }
+
+  /* The thread runs the code of the module until the process exits. */
+  if (os_module != NULL)
+    g_module_make_resident (os_module);
+
+  os_workarea_thread = TRUE;
+
+  return TRUE;
+}
+
+/* Callback called when the monitors of the screen change. */
+static void
+monitors_changed_cb (GdkScreen *screen,
+                     gpointer   user_data)
+{
+  free_monitors ();
+}
+
+/* Calculate the edges of a monitor, excluding the struts. */
+static void
+calc_monitor_edges (OsMonitor *monitor)
+{
+  cairo_region_t *monitor_workarea;
+  cairo_region_t *struts_region;
+  cairo_rectangle_int_t rect;
+  gint i;
+
+  rect.x = monitor->geometry.x;
+  rect.y = monitor->geometry.y;
+  rect.width = monitor->geometry.width;
+  rect.height = monitor->geometry.height;
+
+  monitor->x1 = rect.x;
+  monitor->x2 = rect.x + rect.width;
+  monitor->y1 = rect.y;
+  monitor->y2 = rect.y + rect.height;
+
+  if (cairo_region_is_empty (os_workarea))
+    return;
+
+  /* Full monitor region. */
+  monitor_workarea = cairo_region_create_rectangle (&rect);
+  struts_region = cairo_region_copy (monitor_workarea);
+
+  /* Workarea region for current monitor. */
+  cairo_region_intersect (monitor_workarea, os_workarea);
+
+  /* Struts region for current monitor. */
+  cairo_region_subtract (struts_region, monitor_workarea);
+
+  for (i = 0; i < cairo_region_num_rectangles (struts_region); i++)
+    {
+      OsStrutSideFlags strut_side;
+      cairo_rectangle_int_t tmp_rect;
+      gint count;
+
+      cairo_region_get_rectangle (struts_region, i, &tmp_rect);
+
+      strut_side = OS_STRUT_SIDE_NONE;
+      count = 0;
+
+      /* Determine which side the strut is on. */
+      if (tmp_rect.y == rect.y)
+        {
+          strut_side |= OS_STRUT_SIDE_TOP;
+          count++;
+        }
+
+      if (tmp_rect.x == rect.x)
+        {
+          strut_side |= OS_STRUT_SIDE_LEFT;
+          count++;
+        }
+
+      if (tmp_rect.x + tmp_rect.width == rect.x + rect.width)
+        {
+          strut_side |= OS_STRUT_SIDE_RIGHT;
+          count++;
+        }
 
-      if (os_root_list == NULL)
+      if (tmp_rect.y + tmp_rect.height == rect.y + rect.height)
         {
-          GdkScreen *screen;
-          GdkWindow *root;
+          strut_side |= OS_STRUT_SIDE_BOTTOM;
+          count++;
+        }
+
+      /* Handle multiple sides. */
+      if (count >= 2)
+        {
+          if (tmp_rect.width > tmp_rect.height)
+            strut_side &= ~(OS_STRUT_SIDE_LEFT | OS_STRUT_SIDE_RIGHT);
+          else if (tmp_rect.width < tmp_rect.height)
+            strut_side &= ~(OS_STRUT_SIDE_TOP | OS_STRUT_SIDE_BOTTOM);
+        }
+
+      /* Get the monitor boundaries using the strut. */
+      if (strut_side & OS_STRUT_SIDE_LEFT)
+        {
+          if (tmp_rect.x + tmp_rect.width > monitor->x1)
+            monitor->x1 = tmp_rect.x + tmp_rect.width;
+        }
+
+      if (strut_side & OS_STRUT_SIDE_RIGHT)
+        {
+          if (tmp_rect.x < monitor->x2)
+            monitor->x2 = tmp_rect.x;
+        }
+
+      if (strut_side & OS_STRUT_SIDE_TOP)
+        {
+          if (tmp_rect.y + tmp_rect.height > monitor->y1)
+            monitor->y1 = tmp_rect.y + tmp_rect.height;
+        }
+
+      if (strut_side & OS_STRUT_SIDE_BOTTOM)
+        {
+          if (tmp_rect.y < monitor->y2)
+            monitor->y2 = tmp_rect.y;
+        }
+    }
+
+  cairo_region_destroy (monitor_workarea);
+  cairo_region_destroy (struts_region);
+}
+
+/* Build the monitor table of the screen, if it's not up to date. */
+static void
+calc_monitors (GdkScreen *screen)
+{
+  gint i;
+
+  if (screen != os_monitors_screen)
+    {
+      if (os_monitors_screen != NULL)
+        g_signal_handlers_disconnect_by_func (os_monitors_screen,
+                                              G_CALLBACK (monitors_changed_cb), NULL);
+
+      free_monitors ();
+
+      os_monitors_screen = screen;
+
+      if (!workarea_thread_is_alive ())
+        queue_workarea_update (screen);
+
+      g_signal_connect (G_OBJECT (screen), "monitors-changed",
+                        G_CALLBACK (monitors_changed_cb), NULL);
+    }
+
+  /* Pick the latest snapshot of the watcher thread, if any. */
+  if (os_workarea_thread)
+    {
+      OsWorkareaSnapshot *snapshot;
+
+      snapshot = take_workarea_snapshot ();
+
+      if (snapshot != NULL)
+        {
+          set_workarea (snapshot->values, snapshot->n_values);
+          workarea_snapshot_free (snapshot);
+        }
+      else if (!os_workarea_fetched)
+        {
+          /* The snapshot is not published yet, or it was consumed
+           * by a previous workarea, fetch it without blocking. */
+          queue_workarea_update (screen);
+        }
+    }
+
+  if (os_monitors != NULL)
+    return;
+
+  os_n_monitors = gdk_screen_get_n_monitors (screen);
+  os_monitors = g_new (OsMonitor, os_n_monitors);
+
+  for (i = 0; i < os_n_monitors; i++)
+    {
+      gdk_screen_get_monitor_geometry (screen, i, &os_monitors[i].geometry);
+      calc_monitor_edges (&os_monitors[i]);
+    }
+}
+
+/* Get the monitor at the point, or the nearest one,
+ * like gdk_screen_get_monitor_at_point () does. */
+static gint
+get_monitor_at_point (gint x,
+                      gint y)
+{
+  gint i, nearest, nearest_dist;
+
+  nearest = 0;
+  nearest_dist = G_MAXINT;
+
+  for (i = 0; i < os_n_monitors; i++)
+    {
+      const GdkRectangle *geometry;
+      gint dist_x, dist_y;
+
+      geometry = &os_monitors[i].geometry;
+
+      if (x < geometry->x)
+        dist_x = geometry->x - x;
+      else if (x >= geometry->x + geometry->width)
+        dist_x = x - (geometry->x + geometry->width) + 1;
+      else
+        dist_x = 0;
+
+      if (y < geometry->y)
+        dist_y = geometry->y - y;
+      else if (y >= geometry->y + geometry->height)
+        dist_y = y - (geometry->y + geometry->height) + 1;
+      else
+        dist_y = 0;
+
+      if (dist_x == 0 && dist_y == 0)
+        return i;
+
+      if (dist_x + dist_y < nearest_dist)
+        {
+          nearest = i;
+          nearest_dist = dist_x + dist_y;
+        }
+    }
+
+  return nearest;
+}
+
+/* Start watching the workarea changes on behalf of a scrollbar,
+ * listening to the root window only while a thumb is in use. */
+static void
+watch_workarea (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (priv->watch_workarea)
+    return;
+
+  /* The watcher thread, if running, tracks the changes itself. */
+  if (start_workarea_thread (gtk_widget_get_screen (GTK_WIDGET (scrollbar))))
+    return;
+
+  priv->watch_workarea = TRUE;
+
+  if (os_workarea_watchers++ == 0)
+    {
+      GdkEventMask events;
+
+      os_workarea_root = gdk_screen_get_root_window (gtk_widget_get_screen (GTK_WIDGET (scrollbar)));
+
+      events = gdk_window_get_events (os_workarea_root);
+      os_workarea_events_added = !(events & GDK_PROPERTY_CHANGE_MASK);
+
+      if (os_workarea_events_added)
+        gdk_window_set_events (os_workarea_root, events | GDK_PROPERTY_CHANGE_MASK);
+
+      gdk_window_add_filter (os_workarea_root, root_filter_func, NULL);
+
+      /* Changes were not tracked while nobody was watching,
+       * revalidate the last values without blocking the caller. */
+      queue_workarea_update (gtk_widget_get_screen (GTK_WIDGET (scrollbar)));
+    }
+}
+
+/* Stop watching the workarea changes on behalf of a scrollbar. */
+static void
+unwatch_workarea (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (!priv->watch_workarea)
+    return;
+
+  priv->watch_workarea = FALSE;
+
+  if (--os_workarea_watchers == 0)
+    {
+      gdk_window_remove_filter (os_workarea_root, root_filter_func, NULL);
+
+      if (os_workarea_events_added)
+        gdk_window_set_events (os_workarea_root,
+                               gdk_window_get_events (os_workarea_root) & ~(GDK_PROPERTY_CHANGE_MASK));
+
+      os_workarea_root = NULL;
+    }
+}
+
+/* Check whether the thumb movement can be considered connected or not. */
+static void
+check_connection (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  gint x_pos, y_pos;
 
-          /* Create the static linked list prepending the object. */
-          os_root_list = g_slist_prepend (os_root_list, widget);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  /* This seems to be required to get proper values. */
+  calc_layout (scrollbar, gtk_adjustment_get_value (priv->adjustment));
 
-          if (os_workarea == NULL)
-            os_workarea = cairo_region_create ();
+  os_thumb_get_position (OS_THUMB (priv->thumb), &x_pos, &y_pos);
 
-          /* Apply the root_filter_func. */
-          screen = gtk_widget_get_screen (widget);
-          root = gdk_screen_get_root_window (screen);
-          gdk_window_set_events (root, gdk_window_get_events (root) |
-                                       GDK_PROPERTY_CHANGE_MASK);
-          gdk_window_add_filter (root, root_filter_func, NULL);
+  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+    {
+      if (priv->overlay.height > priv->slider.height)
+        {
+          if (y_pos >= priv->thumb_win.y + priv->overlay.y &&
+              y_pos + priv->slider.height <= priv->thumb_win.y + priv->overlay.y + priv->overlay.height)
+            priv->state |= OS_STATE_CONNECTED;
+          else
+            priv->state &= ~(OS_STATE_CONNECTED);
         }
       else
         {
-          /* Prepend the object to the static linked list. */
-          os_root_list = g_slist_prepend (os_root_list, widget);
+          if (y_pos == priv->thumb_win.y + priv->slider.y)
+            priv->state |= OS_STATE_CONNECTED;
+          else
+            priv->state &= ~(OS_STATE_CONNECTED);
+        }
+    }
+  else
+    {
+      if (priv->overlay.width > priv->slider.width)
+        {
+          if (x_pos >= priv->thumb_win.x + priv->overlay.x &&
+              x_pos + priv->slider.width <= priv->thumb_win.x + priv->overlay.x + priv->overlay.width)
+            priv->state |= OS_STATE_CONNECTED;
+          else
+            priv->state &= ~(OS_STATE_CONNECTED);
         }
+      else
+        {
+          if (x_pos == priv->thumb_win.x + priv->slider.x)
+            priv->state |= OS_STATE_CONNECTED;
+          else
+            priv->state &= ~(OS_STATE_CONNECTED);
+        }
+    }
+}
+
+/* Convert coordinates into GtkRange values. */
+static inline gdouble
+coord_to_value (GtkScrollbar *scrollbar,
+                gfloat        coord)
+{
+  OsScrollbarPrivate *priv;
+  gdouble frac;
+  gdouble value;
+  gint    trough_length;
+  gint    slider_length;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+    {
+      trough_length = priv->trough.height;
+      slider_length = MAX (priv->slider.height, priv->overlay.height);
+    }
+  else
+    {
+      trough_length = priv->trough.width;
+      slider_length = MAX (priv->slider.width, priv->overlay.width);
+    }
+
+  if (trough_length == slider_length)
+    frac = 1.0;
+  else
+    frac = (MAX (0, coord) / (gdouble) (trough_length - slider_length));
+
+  value = gtk_adjustment_get_lower (priv->adjustment) + frac * (gtk_adjustment_get_upper (priv->adjustment) -
+                                                                gtk_adjustment_get_lower (priv->adjustment) -
+                                                                gtk_adjustment_get_page_size (priv->adjustment));
+
+  value = CLAMP (value,
+                 gtk_adjustment_get_lower (priv->adjustment),
+                 gtk_adjustment_get_upper (priv->adjustment) - gtk_adjustment_get_page_size (priv->adjustment));
+
+  return value;
+}
+
+/* destroy the private struct */
+static void
+destroy_private (gpointer data)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = data;
+
+  os_timer_cancel (&priv->hide_thumb_timer);
+  os_timer_cancel (&priv->show_thumb_timer);
+  os_timer_cancel (&priv->unlock_thumb_timer);
+
+  g_slice_free (OsScrollbarPrivate, priv);
+}
+
+/* Link an object at the head of a queue,
+ * using a link embedded in the object instead of allocating one. */
+static void
+registry_link (GQueue         *queue,
+               OsRegistryLink *entry,
+               gpointer        data)
+{
+  if (entry->queue != NULL)
+    return;
+
+  entry->link.data = data;
+  entry->queue = queue;
+
+  g_queue_push_head_link (queue, &entry->link);
+}
+
+/* Unlink an object from the queue holding it, in constant time. */
+static void
+registry_unlink (OsRegistryLink *entry)
+{
+  if (entry->queue == NULL)
+    return;
+
+  g_queue_unlink (entry->queue, &entry->link);
+
+  entry->link.data = NULL;
+  entry->queue = NULL;
+}
+
+/* Unlink every object of a queue that is going away. */
+static void
+registry_clear (GQueue *queue)
+{
+  while (!g_queue_is_empty (queue))
+    registry_unlink ((OsRegistryLink*) queue->head);
+}
+
+/* Get the private struct. If there isn't one, return NULL */
+static OsScrollbarPrivate*
+lookup_private (GtkWidget *widget)
+{
+  return g_object_get_qdata (G_OBJECT (widget), os_quark_qdata);
+}
+
+/* Get the private struct. If there isn't one, create it */
+static OsScrollbarPrivate*
+get_private (GtkWidget *widget)
+{
+  OsScrollbarPrivate *priv;
+
+  /* Fetch the private qdata struct. */
+  priv = lookup_private (widget);
+
+  if (!priv)
+    {
+      /* The widget doesn't have an associated qdata,
+       * initialize and store it. */
+      OsScrollbarPrivate *qdata;
+
+      /* Describe the widget for theming. */
+      gtk_widget_set_name (widget, "OsScrollbar");
+
+      if (g_hash_table_size (os_root_table) == 0 &&
+          os_workarea == NULL)
+        os_workarea = cairo_region_create ();
+
+      /* Add the object to the static set. */
+      g_hash_table_insert (os_root_table, widget, widget);
 
       /* Initialize memory. */
       qdata = g_slice_new0 (OsScrollbarPrivate);
@@ -618,19 +1468,19 @@ get_private (GtkWidget *widget)
       qdata->hidable_thumb = TRUE;
       qdata->fine_scroll_multiplier = 1.0;
       qdata->bar = os_bar_new ();
-      qdata->window_group = gtk_window_group_new ();
-      qdata->animation = os_animation_new (RATE_ANIMATION, MAX_DURATION_SCROLLING,
-                                           scrolling_cb, scrolling_end_cb, widget);
+
+      os_timer_init (&qdata->hide_thumb_timer, hide_thumb_cb, widget);
+      os_timer_init (&qdata->show_thumb_timer, show_thumb_cb, widget);
+      os_timer_init (&qdata->unlock_thumb_timer, unlock_thumb_cb, widget);
 
       /* Store qdata. */
       g_object_set_qdata_full (G_OBJECT (widget), os_quark_qdata, qdata, destroy_private);
       priv = qdata;
 
-      /* Create adjustment and thumb. */
+      /* Create adjustment, the thumb is created by get_thumb (). */
       if (gtk_range_get_adjustment (GTK_RANGE (widget)))
         swap_adjustment (GTK_SCROLLBAR (widget), gtk_range_get_adjustment (GTK_RANGE (widget)));
       priv->orientation = gtk_orientable_get_orientation (GTK_ORIENTABLE (widget));
-      swap_thumb (GTK_SCROLLBAR (widget), os_thumb_new (priv->orientation));
 
       priv->resizing_paned = FALSE;
 
@@ -639,37 +1489,76 @@ get_private (GtkWidget *widget)
                         G_CALLBACK (notify_adjustment_cb), NULL);
       g_signal_connect (G_OBJECT (widget), "notify::orientation",
                         G_CALLBACK (notify_orientation_cb), NULL);
+      g_signal_connect (G_OBJECT (widget), "hierarchy-changed",
+                        G_CALLBACK (hierarchy_changed_cb), NULL);
     }
 
   return priv;
 }
 
-/* Hide the thumb if it's the case. */
+/* Get the thumb. If there isn't one, create it,
+ * together with the animation it uses.
+ * Most scrollbars are never approached, so these are created
+ * on the first proximity instead of in get_private (). */
+static GtkWidget*
+get_thumb (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (priv->thumb == NULL)
+    {
+      priv->animation = os_animation_new (RATE_ANIMATION, MAX_DURATION_SCROLLING,
+                                          scrolling_cb, scrolling_end_cb, scrollbar);
+
+      swap_thumb (scrollbar, os_thumb_new (priv->orientation));
+
+      if (priv->slider.width > 0 && priv->slider.height > 0)
+        os_thumb_resize (OS_THUMB (priv->thumb), priv->slider.width, priv->slider.height);
+
+      join_window_group (scrollbar);
+    }
+
+  return priv->thumb;
+}
+
+/* Check if the thumb is mapped, FALSE if it wasn't created yet. */
+static gboolean
+is_thumb_mapped (OsScrollbarPrivate *priv)
+{
+  return priv->thumb != NULL && gtk_widget_get_mapped (priv->thumb);
+}
+
+/* Hide the thumb window, if it was created. */
 static void
-hide_thumb (GtkScrollbar *scrollbar)
+hide_thumb_window (GtkScrollbar *scrollbar)
 {
   OsScrollbarPrivate *priv;
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  if (priv->hidable_thumb)
+  if (priv->thumb != NULL)
     gtk_widget_hide (priv->thumb);
 }
 
-/* Timeout before hiding the thumb. */
-static gboolean
-hide_thumb_cb (gpointer user_data)
+/* Hide the thumb if it's the case. */
+static void
+hide_thumb (GtkScrollbar *scrollbar)
 {
-  GtkScrollbar *scrollbar;
   OsScrollbarPrivate *priv;
 
-  scrollbar = GTK_SCROLLBAR (user_data);
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  hide_thumb (scrollbar);
-  priv->source_hide_thumb_id = 0;
+  if (priv->hidable_thumb)
+    hide_thumb_window (scrollbar);
+}
 
-  return FALSE;
+/* Timeout before hiding the thumb. */
+static void
+hide_thumb_cb (gpointer user_data)
+{
+  hide_thumb (GTK_SCROLLBAR (user_data));
 }
 
 /* Return TRUE if the widget is insensitive. */
@@ -688,6 +1577,13 @@ move_bar (GtkScrollbar *scrollbar)
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
+  /* Nobody can see the bar, move it when the toplevel is viewable. */
+  if (priv->suspended)
+    {
+      priv->update |= OS_UPDATE_LAYOUT;
+      return;
+    }
+
   if (priv->orientation == GTK_ORIENTATION_VERTICAL)
     {
       mask.x = 0;
@@ -750,7 +1646,7 @@ scrolling_end_cb (gpointer user_data)
     {
       gint x_pos, y_pos;
 
-      gdk_window_get_origin (gtk_widget_get_window (priv->thumb), &x_pos, &y_pos);
+      os_thumb_get_position (OS_THUMB (priv->thumb), &x_pos, &y_pos);
 
       calc_precise_slide_values (scrollbar, x_pos + priv->pointer.x, y_pos + priv->pointer.y);
     }
@@ -768,117 +1664,25 @@ sanitize_x (GtkScrollbar *scrollbar,
             gint          x,
             gint          y)
 {
-  GdkRectangle gdk_rect;
-  GdkScreen *screen;
   OsScrollbarPrivate *priv;
-  cairo_rectangle_int_t rect;
   gint screen_x, screen_width, n_monitor, monitor_x;
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
   /* The x - 1 coordinate shift is done
    * to calculate monitor boundaries. */
-  monitor_x = priv->side == OS_SIDE_LEFT ? x : x - 1;
-
-  screen = gtk_widget_get_screen (GTK_WIDGET (scrollbar));
-  n_monitor = gdk_screen_get_monitor_at_point (screen, monitor_x, y);
-  gdk_screen_get_monitor_geometry (screen, n_monitor, &gdk_rect);
-
-  rect.x = gdk_rect.x;
-  rect.y = gdk_rect.y;
-  rect.width = gdk_rect.width;
-  rect.height = gdk_rect.height;
-
-  screen_x = rect.x;
-  screen_width = rect.x + rect.width;
-
-  if (!cairo_region_is_empty (os_workarea))
-    {
-      cairo_region_t *monitor_workarea;
-      cairo_region_t *struts_region;
-      cairo_rectangle_int_t tmp_rect;
-      gint i, reg_x, reg_width;
-
-      reg_x = rect.x;
-      reg_width = rect.x + rect.width;
-
-      /* Full monitor region. */
-      monitor_workarea = cairo_region_create_rectangle (&rect);
-      struts_region = cairo_region_copy (monitor_workarea);
-
-      /* Workarea region for current monitor. */
-      cairo_region_intersect (monitor_workarea, os_workarea);
-
-      /* Struts region for current monitor. */
-      cairo_region_subtract (struts_region, monitor_workarea);
-
-      for (i = 0; i < cairo_region_num_rectangles (struts_region); i++)
-        {
-          OsStrutSideFlags strut_side;
-          gint count;
-
-          cairo_region_get_rectangle (struts_region, i, &tmp_rect);
-
-          strut_side = OS_STRUT_SIDE_NONE;
-          count = 0;
-
-          /* Determine which side the strut is on. */
-          if (tmp_rect.y == rect.y)
-            {
-              strut_side |= OS_STRUT_SIDE_TOP;
-              count++;
-            }
-
-          if (tmp_rect.x == rect.x)
-            {
-              strut_side |= OS_STRUT_SIDE_LEFT;
-              count++;
-            }
-
-          if (tmp_rect.x + tmp_rect.width == rect.x + rect.width)
-            {
-              strut_side |= OS_STRUT_SIDE_RIGHT;
-              count++;
-            }
-
-          if (tmp_rect.y + tmp_rect.height == rect.y + rect.height)
-            {
-              strut_side |= OS_STRUT_SIDE_BOTTOM;
-              count++;
-            }
-
-          /* Handle multiple sides. */
-          if (count >= 2)
-            {
-              if (tmp_rect.width > tmp_rect.height)
-                strut_side &= ~(OS_STRUT_SIDE_LEFT | OS_STRUT_SIDE_RIGHT);
-              else if (tmp_rect.width < tmp_rect.height)
-                strut_side &= ~(OS_STRUT_SIDE_TOP | OS_STRUT_SIDE_BOTTOM);
-            }
-
-          /* Get the monitor boundaries using the strut. */
-          if (strut_side & OS_STRUT_SIDE_LEFT)
-            {
-              if (tmp_rect.x + tmp_rect.width > reg_x)
-                reg_x = tmp_rect.x + tmp_rect.width;
-            }
-
-          if (strut_side & OS_STRUT_SIDE_RIGHT)
-            {
-              if (tmp_rect.x < reg_width)
-                reg_width = tmp_rect.x;
-            }
-        }
+  monitor_x = priv->side == OS_SIDE_LEFT ? x : x - 1;
 
-      screen_x = reg_x;
-      screen_width = reg_width;
+  watch_workarea (scrollbar);
+  calc_monitors (gtk_widget_get_screen (GTK_WIDGET (scrollbar)));
 
-      cairo_region_destroy (monitor_workarea);
-      cairo_region_destroy (struts_region);
-    }
+  n_monitor = get_monitor_at_point (monitor_x, y);
+
+  screen_x = os_monitors[n_monitor].x1;
+  screen_width = os_monitors[n_monitor].x2;
 
   if (priv->side == OS_SIDE_RIGHT &&
-      (n_monitor != gdk_screen_get_monitor_at_point (screen, monitor_x + priv->thumb_all.width, y) ||
+      (n_monitor != get_monitor_at_point (monitor_x + priv->thumb_all.width, y) ||
        monitor_x + priv->thumb_all.width >= screen_width))
     {
       priv->state |= OS_STATE_INTERNAL;
@@ -886,7 +1690,7 @@ sanitize_x (GtkScrollbar *scrollbar,
     }
 
   if (priv->side == OS_SIDE_LEFT &&
-      (n_monitor != gdk_screen_get_monitor_at_point (screen, monitor_x - priv->thumb_all.width, y) ||
+      (n_monitor != get_monitor_at_point (monitor_x - priv->thumb_all.width, y) ||
        monitor_x - priv->thumb_all.width <= screen_x))
     {
       priv->state |= OS_STATE_INTERNAL;
@@ -905,10 +1709,7 @@ sanitize_y (GtkScrollbar *scrollbar,
             gint          x,
             gint          y)
 {
-  GdkRectangle gdk_rect;
-  GdkScreen *screen;
   OsScrollbarPrivate *priv;
-  cairo_rectangle_int_t rect;
   gint screen_y, screen_height, n_monitor, monitor_y;
 
   priv = get_private (GTK_WIDGET (scrollbar));
@@ -917,105 +1718,16 @@ sanitize_y (GtkScrollbar *scrollbar,
    * to calculate monitor boundaries. */
   monitor_y = priv->side == OS_SIDE_TOP ? y : y - 1;
 
-  screen = gtk_widget_get_screen (GTK_WIDGET (scrollbar));
-  n_monitor = gdk_screen_get_monitor_at_point (screen, x, monitor_y);
-  gdk_screen_get_monitor_geometry (screen, n_monitor, &gdk_rect);
-
-  rect.x = gdk_rect.x;
-  rect.y = gdk_rect.y;
-  rect.width = gdk_rect.width;
-  rect.height = gdk_rect.height;
-
-  screen_y = rect.y;
-  screen_height = rect.y + rect.height;
-
-  if (!cairo_region_is_empty (os_workarea))
-    {
-      cairo_region_t *monitor_workarea;
-      cairo_region_t *struts_region;
-      cairo_rectangle_int_t tmp_rect;
-      gint i, reg_y, reg_height;
-
-      reg_y = rect.y;
-      reg_height = rect.y + rect.height;
-
-      /* Full monitor region. */
-      monitor_workarea = cairo_region_create_rectangle (&rect);
-      struts_region = cairo_region_copy (monitor_workarea);
-
-      /* Workarea region for current monitor. */
-      cairo_region_intersect (monitor_workarea, os_workarea);
-
-      /* Struts region for current monitor. */
-      cairo_region_subtract (struts_region, monitor_workarea);
-
-      for (i = 0; i < cairo_region_num_rectangles (struts_region); i++)
-        {
-          OsStrutSideFlags strut_side;
-          gint count;
-
-          cairo_region_get_rectangle (struts_region, i, &tmp_rect);
-
-          strut_side = OS_STRUT_SIDE_NONE;
-          count = 0;
-
-          /* Determine which side the strut is on. */
-          if (tmp_rect.y == rect.y)
-            {
-              strut_side |= OS_STRUT_SIDE_TOP;
-              count++;
-            }
-
-          if (tmp_rect.x == rect.x)
-            {
-              strut_side |= OS_STRUT_SIDE_LEFT;
-              count++;
-            }
-
-          if (tmp_rect.x + tmp_rect.width == rect.x + rect.width)
-            {
-              strut_side |= OS_STRUT_SIDE_RIGHT;
-              count++;
-            }
-
-          if (tmp_rect.y + tmp_rect.height == rect.y + rect.height)
-            {
-              strut_side |= OS_STRUT_SIDE_BOTTOM;
-              count++;
-            }
-
-          /* Handle multiple sides. */
-          if (count >= 2)
-            {
-              if (tmp_rect.width > tmp_rect.height)
-                strut_side &= ~(OS_STRUT_SIDE_LEFT | OS_STRUT_SIDE_RIGHT);
-              else if (tmp_rect.width < tmp_rect.height)
-                strut_side &= ~(OS_STRUT_SIDE_TOP | OS_STRUT_SIDE_BOTTOM);
-            }
-
-          /* Get the monitor boundaries using the strut. */
-          if (strut_side & OS_STRUT_SIDE_TOP)
-            {
-              if (tmp_rect.y + tmp_rect.height > reg_y)
-                reg_y = tmp_rect.y + tmp_rect.height;
-            }
-
-          if (strut_side & OS_STRUT_SIDE_BOTTOM)
-            {
-              if (tmp_rect.y < reg_height)
-                reg_height = tmp_rect.y;
-            }
-        }
+  watch_workarea (scrollbar);
+  calc_monitors (gtk_widget_get_screen (GTK_WIDGET (scrollbar)));
 
-      screen_y = reg_y;
-      screen_height = reg_height;
+  n_monitor = get_monitor_at_point (x, monitor_y);
 
-      cairo_region_destroy (monitor_workarea);
-      cairo_region_destroy (struts_region);
-    }
+  screen_y = os_monitors[n_monitor].y1;
+  screen_height = os_monitors[n_monitor].y2;
 
   if (priv->side == OS_SIDE_BOTTOM &&
-      (n_monitor != gdk_screen_get_monitor_at_point (screen, x, monitor_y + priv->thumb_all.height) ||
+      (n_monitor != get_monitor_at_point (x, monitor_y + priv->thumb_all.height) ||
        monitor_y + priv->thumb_all.height >= screen_height))
     {
       priv->state |= OS_STATE_INTERNAL;
@@ -1023,7 +1735,7 @@ sanitize_y (GtkScrollbar *scrollbar,
     }
 
   if (priv->side == OS_SIDE_TOP &&
-      (n_monitor != gdk_screen_get_monitor_at_point (screen, x, monitor_y - priv->thumb_all.height) ||
+      (n_monitor != get_monitor_at_point (x, monitor_y - priv->thumb_all.height) ||
        monitor_y - priv->thumb_all.height <= screen_y))
     {
       priv->state |= OS_STATE_INTERNAL;
@@ -1046,9 +1758,9 @@ move_thumb (GtkScrollbar *scrollbar,
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  gtk_window_move (GTK_WINDOW (priv->thumb),
-                   sanitize_x (scrollbar, x, y),
-                   sanitize_y (scrollbar, x, y));
+  os_thumb_move (OS_THUMB (get_thumb (scrollbar)),
+                 sanitize_x (scrollbar, x, y),
+                 sanitize_y (scrollbar, x, y));
 }
 
 /* Callback called when the adjustment changes. */
@@ -1063,6 +1775,22 @@ notify_adjustment_cb (GObject *object,
   swap_adjustment (scrollbar, gtk_range_get_adjustment (GTK_RANGE (object)));
 }
 
+/* Callback called when the hierarchy changes,
+ * the paned and the resizability need a new look up. */
+static void
+hierarchy_changed_cb (GtkWidget *widget,
+                      GtkWidget *previous_toplevel,
+                      gpointer   user_data)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (widget);
+
+  priv->paned = NULL;
+  priv->paned_valid = FALSE;
+  priv->resize_geometry.valid = FALSE;
+}
+
 /* Callback called when the orientation changes. */
 static void
 notify_orientation_cb (GObject *object,
@@ -1075,8 +1803,11 @@ notify_orientation_cb (GObject *object,
   priv = get_private (GTK_WIDGET (scrollbar));
 
   priv->orientation = gtk_orientable_get_orientation (GTK_ORIENTABLE (object));
+  priv->allocation_valid = FALSE;
 
-  swap_thumb (scrollbar, os_thumb_new (priv->orientation));
+  /* Replace the thumb only if it was already created. */
+  if (priv->thumb != NULL)
+    swap_thumb (scrollbar, os_thumb_new (priv->orientation));
 }
 
 /* Stop function called by the scrolling animation. */
@@ -1110,6 +1841,9 @@ swap_adjustment (GtkScrollbar  *scrollbar,
 
   if (priv->adjustment != NULL)
     {
+      cancel_drag (scrollbar);
+      cancel_wheel (scrollbar);
+
       g_signal_handlers_disconnect_by_func (G_OBJECT (priv->adjustment),
                                             G_CALLBACK (adjustment_changed_cb), scrollbar);
       g_signal_handlers_disconnect_by_func (G_OBJECT (priv->adjustment),
@@ -1158,6 +1892,8 @@ swap_thumb (GtkScrollbar *scrollbar,
                                             thumb_scroll_event_cb, scrollbar);
       g_signal_handlers_disconnect_by_func (G_OBJECT (priv->thumb),
                                             thumb_unmap_cb, scrollbar);
+      g_signal_handlers_disconnect_by_func (G_OBJECT (priv->thumb),
+                                            thumb_unrealize_cb, scrollbar);
 
       gtk_widget_destroy (priv->thumb);
 
@@ -1186,11 +1922,13 @@ swap_thumb (GtkScrollbar *scrollbar,
                         G_CALLBACK (thumb_scroll_event_cb), scrollbar);
       g_signal_connect (G_OBJECT (priv->thumb), "unmap",
                         G_CALLBACK (thumb_unmap_cb), scrollbar);
+      g_signal_connect (G_OBJECT (priv->thumb), "unrealize",
+                        G_CALLBACK (thumb_unrealize_cb), scrollbar);
     }
 }
 
 /* Timeout before unlocking the thumb. */
-static gboolean
+static void
 unlock_thumb_cb (gpointer user_data)
 {
   GtkScrollbar *scrollbar;
@@ -1201,10 +1939,6 @@ unlock_thumb_cb (gpointer user_data)
 
   if (priv->hidable_thumb)
     priv->state &= ~(OS_STATE_LOCKED);
-
-  priv->source_unlock_thumb_id = 0;
-
-  return FALSE;
 }
 
 /* Get the window at pointer. */
@@ -1250,45 +1984,7 @@ static void
 adjustment_changed_cb (GtkAdjustment *adjustment,
                        gpointer       user_data)
 {
-  GtkScrollbar *scrollbar;
-  OsScrollbarPrivate *priv;
-
-  scrollbar = GTK_SCROLLBAR (user_data);
-  priv = get_private (GTK_WIDGET (scrollbar));
-
-  /* FIXME(Cimi) we should control each time os_bar_show ()/hide ()
-   * is called here and in map ()/unmap ().
-   * We are arbitrary calling that and I'm frightened we should show or keep
-   * hidden a bar that is meant to be hidden/shown.
-   * I don't want to see bars reappearing because
-   * of a change in the adjustment of an invisible bar or viceversa. */
-  if (gtk_adjustment_get_upper (adjustment) - gtk_adjustment_get_lower (adjustment) >
-      gtk_adjustment_get_page_size (adjustment))
-    {
-      priv->state &= ~(OS_STATE_FULLSIZE);
-      if (priv->filter.proximity)
-        os_bar_show (priv->bar);
-    }
-  else
-    {
-      priv->state |= OS_STATE_FULLSIZE;
-      if (priv->filter.proximity)
-        {
-          os_bar_hide (priv->bar);
-
-          gtk_widget_hide (priv->thumb);
-        }
-    }
-
-  calc_layout_bar (scrollbar, gtk_adjustment_get_value (adjustment));
-  calc_layout_slider (scrollbar, gtk_adjustment_get_value (adjustment));
-  calc_fine_scroll_multiplier (scrollbar);
-
-  if (!(priv->event & OS_EVENT_ENTER_NOTIFY) &&
-      !(priv->event & OS_EVENT_MOTION_NOTIFY))
-    gtk_widget_hide (priv->thumb);
-
-  move_bar (scrollbar);
+  queue_update (GTK_SCROLLBAR (user_data), OS_UPDATE_CHANGED);
 }
 
 /* Update the tail (visual connection) between bar and thumb. */
@@ -1300,7 +1996,7 @@ update_tail (GtkScrollbar *scrollbar)
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  gdk_window_get_origin (gtk_widget_get_window (priv->thumb), &x_pos, &y_pos);
+  os_thumb_get_position (OS_THUMB (priv->thumb), &x_pos, &y_pos);
 
   if (priv->orientation == GTK_ORIENTATION_VERTICAL)
     {
@@ -1392,20 +2088,71 @@ static void
 adjustment_value_changed_cb (GtkAdjustment *adjustment,
                              gpointer       user_data)
 {
-  GtkScrollbar *scrollbar;
+  queue_update (GTK_SCROLLBAR (user_data), OS_UPDATE_VALUE);
+}
+
+/* Apply the pending adjustment changes. */
+static void
+flush_update (GtkScrollbar *scrollbar)
+{
   OsScrollbarPrivate *priv;
+  OsUpdateFlags update;
+  gdouble value;
 
-  scrollbar = GTK_SCROLLBAR (user_data);
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  calc_layout_bar (scrollbar, gtk_adjustment_get_value (adjustment));
-  calc_layout_slider (scrollbar, gtk_adjustment_get_value (adjustment));
+  if (priv->source_update_id != 0)
+    {
+      g_source_remove (priv->source_update_id);
+      priv->source_update_id = 0;
+    }
+
+  update = priv->update;
+  priv->update = OS_UPDATE_NONE;
+
+  if (update == OS_UPDATE_NONE)
+    return;
+
+  value = gtk_adjustment_get_value (priv->adjustment);
+
+  if (update & OS_UPDATE_CHANGED)
+    {
+      /* FIXME(Cimi) we should control each time os_bar_show ()/hide ()
+       * is called here and in map ()/unmap ().
+       * We are arbitrary calling that and I'm frightened we should show or keep
+       * hidden a bar that is meant to be hidden/shown.
+       * I don't want to see bars reappearing because
+       * of a change in the adjustment of an invisible bar or viceversa. */
+      if (gtk_adjustment_get_upper (priv->adjustment) - gtk_adjustment_get_lower (priv->adjustment) >
+          gtk_adjustment_get_page_size (priv->adjustment))
+        {
+          priv->state &= ~(OS_STATE_FULLSIZE);
+          if (priv->filter.proximity)
+            os_bar_show (priv->bar);
+        }
+      else
+        {
+          priv->state |= OS_STATE_FULLSIZE;
+          if (priv->filter.proximity)
+            {
+              os_bar_hide (priv->bar);
+
+              hide_thumb_window (scrollbar);
+            }
+        }
+    }
+
+  calc_layout (scrollbar, value);
+
+  if (update & OS_UPDATE_CHANGED)
+    calc_fine_scroll_multiplier (scrollbar);
 
   if (!(priv->event & OS_EVENT_ENTER_NOTIFY) &&
       !(priv->event & OS_EVENT_MOTION_NOTIFY))
-    gtk_widget_hide (priv->thumb);
+    hide_thumb_window (scrollbar);
 
-  if (gtk_widget_get_mapped (priv->thumb) &&
+  if ((update & OS_UPDATE_VALUE) &&
+      is_thumb_mapped (priv) &&
       !((priv->event & OS_EVENT_MOTION_NOTIFY) &&
         (priv->state & OS_STATE_CONNECTED)))
     update_tail (scrollbar);
@@ -1413,6 +2160,48 @@ adjustment_value_changed_cb (GtkAdjustment *adjustment,
   move_bar (scrollbar);
 }
 
+/* Apply the pending adjustment changes, once per frame. */
+static gboolean
+update_cb (gpointer user_data)
+{
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+
+  scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->source_update_id = 0;
+
+  flush_update (scrollbar);
+
+  return FALSE;
+}
+
+/* Mark the scrollbar dirty, updating it right before the next redraw.
+ * While the thumb is in use, the layout must follow the adjustment
+ * at once, so the update is applied immediately. */
+static void
+queue_update (GtkScrollbar  *scrollbar,
+              OsUpdateFlags  update)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->update |= update;
+
+  /* Keep the flags, the update is queued when the toplevel is viewable. */
+  if (priv->suspended)
+    return;
+
+  if (is_thumb_mapped (priv) ||
+      (priv->event & (OS_EVENT_BUTTON_PRESS | OS_EVENT_MOTION_NOTIFY)))
+    flush_update (scrollbar);
+  else if (priv->source_update_id == 0)
+    priv->source_update_id = g_idle_add_full (GDK_PRIORITY_REDRAW - 1, update_cb,
+                                              scrollbar, NULL);
+}
+
 /* Root window functions. */
 
 /* Filter function applied to the root window. */
@@ -1427,10 +2216,9 @@ root_filter_func (GdkXEvent *gdkxevent,
 
   if (xev->type == PropertyNotify)
     {
+      /* Fetch the property from an idle, coalescing bursts of changes. */
       if (xev->xproperty.atom == unity_net_workarea_region_atom)
-        {
-          calc_workarea (xev->xany.display, xev->xany.window);
-        }
+        queue_workarea_update (gdk_window_get_screen (os_workarea_root));
     }
 
   return GDK_FILTER_CONTINUE;
@@ -1460,7 +2248,7 @@ present_window_with_timestamp (Screen  *screen,
   xev.xclient.send_event = True;
   xev.xclient.display = display;
   xev.xclient.window = xid;
-  xev.xclient.message_type = gdk_x11_get_xatom_by_name ("_NET_ACTIVE_WINDOW");
+  xev.xclient.message_type = net_active_window_atom;
   xev.xclient.format = 32;
   xev.xclient.data.l[0] = 1;
   xev.xclient.data.l[1] = timestamp;
@@ -1468,14 +2256,11 @@ present_window_with_timestamp (Screen  *screen,
   xev.xclient.data.l[3] = 0;
   xev.xclient.data.l[4] = 0;
 
-  gdk_error_trap_push ();
-
+  /* Sending to the root window can't fail,
+   * no need to trap errors and to wait for a round trip. */
   XSendEvent (display, root, False,
               SubstructureRedirectMask | SubstructureNotifyMask,
               &xev);
-
-  gdk_flush ();
-  gdk_error_trap_pop ();
 }
 
 /* Present a Gdk window. */
@@ -1502,16 +2287,25 @@ thumb_button_press_event_cb (GtkWidget      *widget,
           event->button == 2)
         {
           GtkScrollbar *scrollbar;
+          GtkWidget *toplevel;
           OsScrollbarPrivate *priv;
 
           scrollbar = GTK_SCROLLBAR (user_data);
           priv = get_private (GTK_WIDGET (scrollbar));
 
-          gtk_window_set_transient_for (GTK_WINDOW (widget),
-                                        GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (scrollbar))));
+          toplevel = gtk_widget_get_toplevel (GTK_WIDGET (scrollbar));
 
-          priv->present_time = g_get_monotonic_time ();
-          present_gdk_window_with_timestamp (GTK_WIDGET (scrollbar), event->time);
+          /* The transient hint is kept across clicks,
+           * only set it when the toplevel changes. */
+          if (gtk_window_get_transient_for (GTK_WINDOW (widget)) != GTK_WINDOW (toplevel))
+            gtk_window_set_transient_for (GTK_WINDOW (widget), GTK_WINDOW (toplevel));
+
+          /* Activate the toplevel only if it's not already active. */
+          if (!gtk_window_is_active (GTK_WINDOW (toplevel)))
+            {
+              priv->present_time = g_get_monotonic_time ();
+              present_gdk_window_with_timestamp (GTK_WIDGET (scrollbar), event->time);
+            }
 
           priv->event |= OS_EVENT_BUTTON_PRESS;
           priv->event &= ~(OS_EVENT_MOTION_NOTIFY);
@@ -1681,8 +2475,6 @@ thumb_button_release_event_cb (GtkWidget      *widget,
           scrollbar = GTK_SCROLLBAR (user_data);
           priv = get_private (GTK_WIDGET (scrollbar));
 
-          gtk_window_set_transient_for (GTK_WINDOW (widget), NULL);
-
           /* Don't trigger actions on thumb dragging or jump-to scrolling. */
           if (event->button == 1 &&
               !(event->state & GDK_SHIFT_MASK) &&
@@ -1712,6 +2504,10 @@ thumb_button_release_event_cb (GtkWidget      *widget,
                 }
             }
 
+          /* Land exactly where the pointer was released. */
+          flush_drag (scrollbar);
+          cancel_drag (scrollbar);
+
           priv->event &= ~(OS_EVENT_BUTTON_PRESS | OS_EVENT_MOTION_NOTIFY);
         }
     }
@@ -1776,80 +2572,282 @@ thumb_leave_notify_event_cb (GtkWidget        *widget,
 
       priv->hidable_thumb = TRUE;
 
-      if (priv->source_hide_thumb_id != 0)
-        g_source_remove (priv->source_hide_thumb_id);
+      os_timer_schedule (&priv->hide_thumb_timer, TIMEOUT_THUMB_HIDE);
+    }
+
+  return FALSE;
+}
+
+/* Restack the thumb above its toplevel using _NET_RESTACK_WINDOW. */
+static void
+send_restack_window (Display *display,
+                     Window   xid,
+                     Window   xid_parent)
+{
+  XEvent xev;
+
+  xev.xclient.type = ClientMessage;
+  xev.xclient.display = display;
+  xev.xclient.serial = 0;
+  xev.xclient.send_event = True;
+  xev.xclient.window = xid;
+  xev.xclient.message_type = net_restack_window_atom;
+  xev.xclient.format = 32;
+  xev.xclient.data.l[0] = 2;
+  xev.xclient.data.l[1] = xid_parent;
+  xev.xclient.data.l[2] = Above;
+  xev.xclient.data.l[3] = 0;
+  xev.xclient.data.l[4] = 0;
+
+  XSendEvent (display, gdk_x11_get_default_root_xwindow (), False,
+              SubstructureRedirectMask | SubstructureNotifyMask,
+              &xev);
+}
+
+/* Free a restack request. */
+static void
+free_restack_request (gpointer data)
+{
+  g_slice_free (OsRestackRequest, data);
+}
+
+/* Retry the failed restack requests using _NET_RESTACK_WINDOW. */
+static gboolean
+restack_fallback_cb (gpointer user_data)
+{
+  Display *display;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  display = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+
+  g_hash_table_iter_init (&iter, restack_table);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      OsRestackRequest *request;
+
+      request = value;
 
-      priv->source_hide_thumb_id = g_timeout_add (TIMEOUT_THUMB_HIDE,
-                                                  hide_thumb_cb,
-                                                  scrollbar);
+      if (request->failed)
+        {
+          request->failed = FALSE;
+          send_restack_window (display, GPOINTER_TO_UINT (key), request->xid_parent);
+        }
     }
 
+  source_restack_id = 0;
+
   return FALSE;
 }
 
+/* X error handler, catching the errors of the restack requests
+ * without a round trip to the server.
+ * The errors are matched by serial, the BadMatch of a restack
+ * on a reparenting window manager doesn't carry the thumb XID. */
+static int
+x_error_handler (Display     *display,
+                 XErrorEvent *error)
+{
+  gpointer xid;
+
+  if (error->request_code == X_ConfigureWindow &&
+      restack_serials != NULL &&
+      g_hash_table_lookup_extended (restack_serials,
+                                    GSIZE_TO_POINTER (error->serial),
+                                    NULL, &xid))
+    {
+      OsRestackRequest *request;
+
+      /* No X requests from the error handler,
+       * the fallback is sent from an idle. */
+      restack_use_net_wm = TRUE;
+
+      /* The thumb might be unrealized already. */
+      request = g_hash_table_lookup (restack_table, xid);
+      if (request != NULL)
+        {
+          request->failed = TRUE;
+
+          if (source_restack_id == 0)
+            source_restack_id = g_idle_add (restack_fallback_cb, NULL);
+        }
+
+      return 0;
+    }
+
+  return (* pre_x_error_handler) (display, error);
+}
+
+/* Forget the restack requests already processed by the server,
+ * their errors, if any, went through x_error_handler (). */
+static gboolean
+restack_serial_processed (gpointer key,
+                          gpointer value,
+                          gpointer user_data)
+{
+  return GPOINTER_TO_SIZE (key) < *(gulong *) user_data;
+}
+
 static void
 thumb_map_cb (GtkWidget *widget,
               gpointer   user_data)
 {
   Display *display;
   GtkScrollbar *scrollbar;
+  GtkWidget *toplevel;
+  OsRestackRequest *request;
+  OsScrollbarPrivate *priv;
   XWindowChanges changes;
-  guint32 xid, xid_parent;
-  unsigned int value_mask = CWSibling | CWStackMode;
-  int res;
+  Window xid, xid_parent;
+  gboolean active_window;
+  gulong processed;
 
   scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (scrollbar));
 
   xid = GDK_WINDOW_XID (gtk_widget_get_window (widget));
-  xid_parent = GDK_WINDOW_XID (gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (scrollbar))));
+  xid_parent = GDK_WINDOW_XID (gtk_widget_get_window (toplevel));
   display = GDK_WINDOW_XDISPLAY (gtk_widget_get_window (GTK_WIDGET (scrollbar)));
 
+  active_window = gtk_window_is_active (GTK_WINDOW (toplevel));
+
+  /* The thumb keeps its stacking position while parked,
+   * it needs to be restacked only if it's a new window
+   * or if the toplevel gained or lost the focus meanwhile,
+   * since the window manager restacks it in that case. */
+  if (xid == priv->restack_xid &&
+      active_window == priv->active_window)
+    return;
+
+  priv->restack_xid = xid;
+  priv->active_window = active_window;
+
+  /* FIXME(Cimi) XConfigureWindow doesn't always work (well, should work only
+   * with compiz 0.8 or older), because it is not handling the reparenting done
+   * at the WM level (metacity and compiz >= 0.9 do reparenting).
+   * Once it failed, restack using the _NET_RESTACK_WINDOW atom. See:
+   * http://standards.freedesktop.org/wm-spec/wm-spec-1.3.html#id2506866
+   * Should work on window managers that supports this, like compiz.
+   * Unfortunately, metacity doesn't yet, so we might decide to implement
+   * this atom in metacity/mutter as well.
+   * We need to restack the window because the thumb window can be above
+   * every window, noticeable when you make the thumb of an unfocused window
+   * appear, and it could be above other windows (like the focused one). */
+  if (restack_use_net_wm)
+    {
+      send_restack_window (display, xid, xid_parent);
+      return;
+    }
+
+  /* Don't wait for the reply, errors are caught by x_error_handler (). */
+  request = g_hash_table_lookup (restack_table, GUINT_TO_POINTER (xid));
+  if (request == NULL)
+    {
+      request = g_slice_new (OsRestackRequest);
+      g_hash_table_insert (restack_table, GUINT_TO_POINTER (xid), request);
+    }
+
+  request->xid_parent = xid_parent;
+  request->failed = FALSE;
+
+  processed = LastKnownRequestProcessed (display);
+  g_hash_table_foreach_remove (restack_serials, restack_serial_processed, &processed);
+
+  g_hash_table_insert (restack_serials,
+                       GSIZE_TO_POINTER (NextRequest (display)),
+                       GUINT_TO_POINTER (xid));
+
   changes.sibling = xid_parent;
   changes.stack_mode = Above;
 
-  gdk_error_trap_push ();
-  XConfigureWindow (display, xid, value_mask, &changes);
-
-  gdk_flush ();
-  if ((res = gdk_error_trap_pop ()))
-    {
-      /* FIXME(Cimi) this code tries to restack the window using
-       * the _NET_RESTACK_WINDOW atom. See:
-       * http://standards.freedesktop.org/wm-spec/wm-spec-1.3.html#id2506866
-       * Should work on window managers that supports this, like compiz.
-       * Unfortunately, metacity doesn't yet, so we might decide to implement
-       * this atom in metacity/mutter as well. 
-       * We need to restack the window because the thumb window can be above
-       * every window, noticeable when you make the thumb of an unfocused window
-       * appear, and it could be above other windows (like the focused one).
-       * XConfigureWindow doesn't always work (well, should work only with
-       * compiz 0.8 or older), because it is not handling the reparenting done
-       * at the WM level (metacity and compiz >= 0.9 do reparenting). */
-      Window root = gdk_x11_get_default_root_xwindow ();
-      XEvent xev;
-
-      xev.xclient.type = ClientMessage;
-      xev.xclient.display = display;
-      xev.xclient.serial = 0;
-      xev.xclient.send_event = True;
-      xev.xclient.window = xid;
-      xev.xclient.message_type = gdk_x11_get_xatom_by_name ("_NET_RESTACK_WINDOW");
-      xev.xclient.format = 32;
-      xev.xclient.data.l[0] = 2;
-      xev.xclient.data.l[1] = xid_parent;
-      xev.xclient.data.l[2] = Above;
-      xev.xclient.data.l[3] = 0;
-      xev.xclient.data.l[4] = 0;
-
-      gdk_error_trap_push ();
-
-      XSendEvent (display, root, False,
-                  SubstructureRedirectMask | SubstructureNotifyMask,
-                  &xev);
-
-      gdk_flush ();
-      gdk_error_trap_pop ();
-    }
+  XConfigureWindow (display, xid, CWSibling | CWStackMode, &changes);
+}
+
+/* Apply the latest value of the drag. */
+static void
+flush_drag (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (priv->drag.pending)
+    {
+      priv->drag.pending = FALSE;
+
+      gtk_adjustment_set_value (priv->adjustment, priv->drag.value);
+    }
+}
+
+/* Drop the drag timeout and its pending value. */
+static void
+cancel_drag (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->drag.pending = FALSE;
+
+  if (priv->drag.source_id != 0)
+    {
+      g_source_remove (priv->drag.source_id);
+      priv->drag.source_id = 0;
+    }
+}
+
+/* Apply at most one drag update per frame. */
+static gboolean
+drag_frame_cb (gpointer user_data)
+{
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+
+  scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (!priv->drag.pending)
+    {
+      priv->drag.source_id = 0;
+
+      return FALSE;
+    }
+
+  flush_drag (scrollbar);
+
+  return TRUE;
+}
+
+/* Set the value of the drag, applying it now if it's the first
+ * of the frame or it reaches an edge, later otherwise. */
+static void
+queue_drag (GtkScrollbar *scrollbar,
+            gdouble       value)
+{
+  OsScrollbarPrivate *priv;
+  gdouble lower, upper;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  lower = gtk_adjustment_get_lower (priv->adjustment);
+  upper = gtk_adjustment_get_upper (priv->adjustment) -
+          gtk_adjustment_get_page_size (priv->adjustment);
+
+  priv->drag.value = CLAMP (value, lower, MAX (lower, upper));
+  priv->drag.pending = TRUE;
+
+  /* The motion handler checks the edges right after the movement. */
+  if (priv->drag.source_id == 0 ||
+      priv->drag.value <= lower ||
+      priv->drag.value >= upper)
+    flush_drag (scrollbar);
+
+  /* Run after the redraw, so the host paints each value it gets. */
+  if (priv->drag.source_id == 0)
+    priv->drag.source_id = g_timeout_add_full (GDK_PRIORITY_REDRAW + 1, RATE_DRAG,
+                                               drag_frame_cb, scrollbar, NULL);
 }
 
 /* From pointer movement, set adjustment value. */
@@ -1878,7 +2876,7 @@ capture_movement (GtkScrollbar *scrollbar,
 
   new_value = coord_to_value (scrollbar, c);
 
-  gtk_adjustment_set_value (priv->adjustment, new_value);
+  queue_drag (scrollbar, new_value);
 }
 
 static GtkPaned*
@@ -1918,6 +2916,25 @@ find_gtk_paned_from_scrollbar(GtkScrollbar *scrollbar)
   return GTK_PANED (temp);
 }
 
+/* Get the paned of the scrollbar, looking it up only
+ * after the hierarchy or the side changed. */
+static GtkPaned*
+get_paned (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (!priv->paned_valid || priv->paned_side != priv->side)
+    {
+      priv->paned = find_gtk_paned_from_scrollbar (scrollbar);
+      priv->paned_side = priv->side;
+      priv->paned_valid = TRUE;
+    }
+
+  return priv->paned;
+}
+
 static gboolean
 thumb_motion_notify_event_cb (GtkWidget      *widget,
                               GdkEventMotion *event,
@@ -2025,7 +3042,7 @@ thumb_motion_notify_event_cb (GtkWidget      *widget,
                   ((priv->side == OS_SIDE_BOTTOM || priv->side == OS_SIDE_TOP) && f_y > TOLERANCE_DRAG))
                 {
                   /* We're in the 'RESIZE' area. */
-                  GtkPaned* paned = find_gtk_paned_from_scrollbar(scrollbar);
+                  GtkPaned* paned = get_paned (scrollbar);
 
                   if (!paned)
                     return FALSE;
@@ -2209,6 +3226,8 @@ thumb_motion_notify_event_cb (GtkWidget      *widget,
                 priv->value = gtk_adjustment_get_upper (priv->adjustment) -
                               gtk_adjustment_get_page_size (priv->adjustment);
 
+              flush_drag (scrollbar);
+
               /* Proceed with the reconnection only if needed. */
               if (priv->value != gtk_adjustment_get_value (priv->adjustment))
                 {
@@ -2294,111 +3313,544 @@ get_wheel_delta (GtkScrollbar       *scrollbar,
   OsScrollbarPrivate *priv;
   gdouble delta;
 
-  priv = get_private (GTK_WIDGET (scrollbar));
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  delta = pow (gtk_adjustment_get_page_size (priv->adjustment), 2.0 / 3.0);
+
+  if (direction == GDK_SCROLL_UP ||
+      direction == GDK_SCROLL_LEFT)
+    delta = - delta;
+
+  return delta;
+}
+
+/* Drop the wheel timeout and its pending delta. */
+static void
+cancel_wheel (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->wheel.delta = 0;
+
+  if (priv->wheel.source_id != 0)
+    {
+      g_source_remove (priv->wheel.source_id);
+      priv->wheel.source_id = 0;
+    }
+}
+
+/* Retarget the scrolling animation with the accumulated wheel delta. */
+static void
+deliver_wheel (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  gdouble new_value;
+  gboolean running;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  running = os_animation_is_running (priv->animation);
+
+  /* If a scrolling animation is running, add the delta to its target. */
+  if (running)
+    new_value = priv->value + priv->wheel.delta;
+  else
+    new_value = gtk_adjustment_get_value (priv->adjustment) + priv->wheel.delta;
+
+  priv->wheel.delta = 0;
+
+  priv->value = CLAMP (new_value,
+                       gtk_adjustment_get_lower (priv->adjustment),
+                       gtk_adjustment_get_upper (priv->adjustment) - gtk_adjustment_get_page_size (priv->adjustment));
+
+  /* Let the running animation go on, scrolling_cb () interpolates
+   * towards the new target. Restarting it every frame would
+   * drop its timeout before it fires, freezing the content. */
+  if (running)
+    {
+      os_animation_extend (priv->animation, DURATION_WHEEL);
+      return;
+    }
+
+  /* There's no need to do start a new animation. */
+  if (priv->value == gtk_adjustment_get_value (priv->adjustment))
+    return;
+
+  os_animation_set_duration (priv->animation, DURATION_WHEEL);
+
+  /* Start the scrolling animation. */
+  os_animation_start (priv->animation);
+}
+
+/* Deliver the wheel delta at most once per frame. */
+static gboolean
+wheel_frame_cb (gpointer user_data)
+{
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+
+  scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (priv->wheel.delta == 0)
+    {
+      priv->wheel.source_id = 0;
+
+      return FALSE;
+    }
+
+  deliver_wheel (scrollbar);
+
+  return TRUE;
+}
+
+static gboolean
+thumb_scroll_event_cb (GtkWidget      *widget,
+                       GdkEventScroll *event,
+                       gpointer        user_data)
+{
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+  gdouble delta;
+
+  scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  /* Deal with simultaneous events. */
+  if (priv->event & OS_EVENT_BUTTON_PRESS)
+    {
+      /* Stop the scrolling animation if it's running. */
+      cancel_wheel (scrollbar);
+      os_animation_stop (priv->animation, NULL);
+
+      /* Slow down scroll wheel with the modifier key pressed,
+       * by a 0.2 factor. */
+      if (event->state & MODIFIER_KEY)
+        delta = get_wheel_delta (scrollbar, event->direction) * 0.2;
+      else
+        delta = get_wheel_delta (scrollbar, event->direction);
+
+      gtk_adjustment_set_value (priv->adjustment,
+                                CLAMP (gtk_adjustment_get_value (priv->adjustment) + delta,
+                                       gtk_adjustment_get_lower (priv->adjustment),
+                                       (gtk_adjustment_get_upper (priv->adjustment) -
+                                        gtk_adjustment_get_page_size (priv->adjustment))));
+
+      priv->event &= ~(OS_EVENT_MOTION_NOTIFY);
+
+      /* we need to update the slide values
+       * with the current position. */
+      calc_precise_slide_values (scrollbar, event->x_root, event->y_root);
+
+      return FALSE;
+    }
+
+  /* Same slow down with the modifier key,
+   * accelerate bursts of events otherwise. */
+  if (event->state & MODIFIER_KEY)
+    {
+      delta = get_wheel_delta (scrollbar, event->direction) * 0.2;
+      priv->wheel.acceleration = 1.0;
+    }
+  else
+    {
+      if (priv->wheel.time != 0 &&
+          event->time - priv->wheel.time < TIMEOUT_WHEEL_BURST)
+        priv->wheel.acceleration = MIN (priv->wheel.acceleration + WHEEL_ACCELERATION_STEP,
+                                        MAX_WHEEL_ACCELERATION);
+      else
+        priv->wheel.acceleration = 1.0;
+
+      delta = get_wheel_delta (scrollbar, event->direction) * priv->wheel.acceleration;
+    }
+
+  priv->wheel.time = event->time;
+
+  priv->wheel.delta += delta;
+
+  /* Deliver the first event now, then at most once per frame. */
+  if (priv->wheel.source_id == 0)
+    {
+      deliver_wheel (scrollbar);
+
+      priv->wheel.source_id = g_timeout_add (RATE_WHEEL, wheel_frame_cb, scrollbar);
+    }
+
+  return FALSE;
+}
+
+static void
+thumb_unmap_cb (GtkWidget *widget,
+                gpointer   user_data)
+{
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+
+  scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->event = OS_EVENT_NONE;
+  priv->hidable_thumb = TRUE;
+  priv->state &= OS_STATE_FULLSIZE;
+
+  /* Remove running hide timeout, if there is one. */
+  os_timer_cancel (&priv->hide_thumb_timer);
+
+  /* This could hardly still be running,
+   * but it is not impossible. */
+  os_timer_cancel (&priv->show_thumb_timer);
+
+  unwatch_workarea (scrollbar);
+
+  os_bar_set_detached (priv->bar, FALSE, TRUE);
+}
+
+static void
+thumb_unrealize_cb (GtkWidget *widget,
+                    gpointer   user_data)
+{
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+
+  scrollbar = GTK_SCROLLBAR (user_data);
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  /* The XID might be reused by another window, forget it. */
+  g_hash_table_remove (restack_table,
+                       GUINT_TO_POINTER (GDK_WINDOW_XID (gtk_widget_get_window (widget))));
+
+  priv->restack_xid = None;
+}
+
+/* Toplevel functions. */
+
+/* Suspend the overlay work of a scrollbar inside a toplevel that isn't viewable:
+ * the updates are kept and the animations paused. */
+static void
+suspend_scrollbar (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->suspended = TRUE;
+
+  if (priv->source_update_id != 0)
+    {
+      g_source_remove (priv->source_update_id);
+      priv->source_update_id = 0;
+    }
+
+  if (priv->animation != NULL)
+    os_animation_pause (priv->animation);
+
+  os_bar_set_suspended (priv->bar, TRUE);
+}
+
+/* Resume a suspended scrollbar, applying the updates kept meanwhile at once. */
+static void
+resume_scrollbar (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  priv->suspended = FALSE;
+
+  if (priv->animation != NULL)
+    os_animation_resume (priv->animation);
+
+  os_bar_set_suspended (priv->bar, FALSE);
+
+  /* Apply the allocation skipped while suspended,
+   * the deferred move follows with the update. */
+  if (priv->update & OS_UPDATE_LAYOUT)
+    os_bar_size_allocate (priv->bar, priv->bar_all);
+
+  if (priv->update != OS_UPDATE_NONE)
+    queue_update (scrollbar, OS_UPDATE_NONE);
+}
+
+/* Free the data of a toplevel. */
+static void
+toplevel_free (gpointer data)
+{
+  OsToplevel *toplevel;
+
+  toplevel = data;
+
+  registry_clear (&toplevel->scrollbars);
+
+  if (toplevel->window_group != NULL)
+    g_object_unref (toplevel->window_group);
+
+  g_slice_free (OsToplevel, toplevel);
+}
+
+/* One listener for all the scrollbars of the toplevel.
+ * Gdk reports configure events of toplevels in root coordinates:
+ * a move only updates the cached origin,
+ * a resize also queues a layout update of the scrollbars. */
+static gboolean
+toplevel_configure_event_cb (GtkWidget         *widget,
+                             GdkEventConfigure *event,
+                             gpointer           user_data)
+{
+  OsToplevel *toplevel;
+  GSList *list;
+  gboolean resized;
+  gint64 current_time;
+
+  toplevel = user_data;
+
+  resized = event->width != toplevel->width ||
+            event->height != toplevel->height;
+
+  toplevel->x = event->x;
+  toplevel->y = event->y;
+  toplevel->width = event->width;
+  toplevel->height = event->height;
+  toplevel->valid = TRUE;
+
+  current_time = g_get_monotonic_time ();
+
+  for (list = toplevel->scrollbars.head; list != NULL; list = list->next)
+    {
+      GtkScrollbar *scrollbar;
+      OsScrollbarPrivate *priv;
+
+      scrollbar = GTK_SCROLLBAR (list->data);
+      priv = get_private (GTK_WIDGET (scrollbar));
+
+      /* The thumb doesn't follow the toplevel, hide it. */
+      if (is_thumb_mapped (priv) &&
+          current_time > priv->present_time + TIMEOUT_PRESENT_WINDOW * 1000)
+        hide_thumb_window (scrollbar);
+
+      priv->state &= ~(OS_STATE_LOCKED);
+
+      if (resized)
+        queue_update (scrollbar, OS_UPDATE_LAYOUT);
+    }
+
+  return FALSE;
+}
+
+/* Suspend or resume the scrollbars of a toplevel,
+ * when it stops or starts being viewable. */
+static void
+update_toplevel_suspended (OsToplevel *toplevel)
+{
+  GList *list;
+  gboolean suspended;
+
+  suspended = !toplevel->mapped || toplevel->obscured;
+
+  if (suspended == toplevel->suspended)
+    return;
+
+  toplevel->suspended = suspended;
+
+  for (list = toplevel->scrollbars.head; list != NULL; list = list->next)
+    {
+      if (suspended)
+        suspend_scrollbar (GTK_SCROLLBAR (list->data));
+      else
+        resume_scrollbar (GTK_SCROLLBAR (list->data));
+    }
+}
+
+/* Invalidate the origin cache, the window manager
+ * could reparent the toplevel when mapping it.
+ * Minimized toplevels and toplevels in other workspaces are unmapped. */
+static gboolean
+toplevel_map_event_cb (GtkWidget *widget,
+                       GdkEvent  *event,
+                       gpointer   user_data)
+{
+  OsToplevel *toplevel;
+
+  toplevel = user_data;
+
+  toplevel->valid = FALSE;
+  toplevel->mapped = event->type == GDK_MAP;
+
+  update_toplevel_suspended (toplevel);
+
+  return FALSE;
+}
+
+/* Track if the toplevel is fully obscured by other windows. */
+static gboolean
+toplevel_visibility_notify_event_cb (GtkWidget          *widget,
+                                     GdkEventVisibility *event,
+                                     gpointer            user_data)
+{
+  OsToplevel *toplevel;
+
+  toplevel = user_data;
+
+  toplevel->obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+
+  update_toplevel_suspended (toplevel);
+
+  return FALSE;
+}
+
+/* Get the data of a toplevel, connecting its listeners the first time. */
+static OsToplevel*
+get_toplevel (GtkWidget *widget)
+{
+  OsToplevel *toplevel;
+
+  toplevel = g_object_get_qdata (G_OBJECT (widget), os_quark_toplevel);
+
+  if (toplevel == NULL)
+    {
+      toplevel = g_slice_new0 (OsToplevel);
+
+      /* Assume it's viewable until told otherwise. */
+      toplevel->mapped = TRUE;
 
-  delta = pow (gtk_adjustment_get_page_size (priv->adjustment), 2.0 / 3.0);
+      g_object_set_qdata_full (G_OBJECT (widget), os_quark_toplevel,
+                               toplevel, toplevel_free);
 
-  if (direction == GDK_SCROLL_UP ||
-      direction == GDK_SCROLL_LEFT)
-    delta = - delta;
+      g_signal_connect (G_OBJECT (widget), "configure-event",
+                        G_CALLBACK (toplevel_configure_event_cb), toplevel);
+      g_signal_connect (G_OBJECT (widget), "map-event",
+                        G_CALLBACK (toplevel_map_event_cb), toplevel);
+      g_signal_connect (G_OBJECT (widget), "unmap-event",
+                        G_CALLBACK (toplevel_map_event_cb), toplevel);
+      g_signal_connect (G_OBJECT (widget), "visibility-notify-event",
+                        G_CALLBACK (toplevel_visibility_notify_event_cb), toplevel);
 
-  return delta;
+      gtk_widget_add_events (widget, GDK_VISIBILITY_NOTIFY_MASK);
+    }
+
+  return toplevel;
 }
 
-static gboolean
-thumb_scroll_event_cb (GtkWidget      *widget,
-                       GdkEventScroll *event,
-                       gpointer        user_data)
+/* Add the toplevel of a realized scrollbar with a thumb to the window group
+ * shared by the thumbs of the toplevel, creating it for the first one.
+ * The toplevel is added to the group once, not on each realize. */
+static void
+join_window_group (GtkScrollbar *scrollbar)
 {
-  GtkScrollbar *scrollbar;
   OsScrollbarPrivate *priv;
-  gdouble delta;
+  OsToplevel *toplevel;
+  GtkWidget *widget;
 
-  scrollbar = GTK_SCROLLBAR (user_data);
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  /* Stop the scrolling animation if it's running. */
-  os_animation_stop (priv->animation, NULL);
+  widget = gtk_widget_get_toplevel (GTK_WIDGET (scrollbar));
 
-  /* Slow down scroll wheel with the modifier key pressed,
-   * by a 0.2 factor. */
-  if (event->state & MODIFIER_KEY)
-    delta = get_wheel_delta (scrollbar, event->direction) * 0.2;
-  else
-    delta = get_wheel_delta (scrollbar, event->direction);
+  if (priv->window_group != NULL ||
+      priv->thumb == NULL ||
+      !gtk_widget_get_realized (GTK_WIDGET (scrollbar)) ||
+      !GTK_IS_WINDOW (widget))
+    return;
 
-  gtk_adjustment_set_value (priv->adjustment,
-                            CLAMP (gtk_adjustment_get_value (priv->adjustment) + delta,
-                                   gtk_adjustment_get_lower (priv->adjustment),
-                                   (gtk_adjustment_get_upper (priv->adjustment) -
-                                    gtk_adjustment_get_page_size (priv->adjustment))));
+  toplevel = get_toplevel (widget);
 
-  /* Deal with simultaneous events. */
-  if (priv->event & OS_EVENT_BUTTON_PRESS)
+  if (toplevel->window_group == NULL)
     {
-      priv->event &= ~(OS_EVENT_MOTION_NOTIFY);
-
-      /* we need to update the slide values
-       * with the current position. */
-      calc_precise_slide_values (scrollbar, event->x_root, event->y_root);
+      toplevel->window_group = gtk_window_group_new ();
+      gtk_window_group_add_window (toplevel->window_group, GTK_WINDOW (widget));
     }
 
-  return FALSE;
+  toplevel->window_group_users++;
+
+  priv->window_group = g_object_ref (toplevel->window_group);
 }
 
+/* Drop the reference to the window group of the toplevel,
+ * the last scrollbar leaving removes the toplevel from the group. */
 static void
-thumb_unmap_cb (GtkWidget *widget,
-                gpointer   user_data)
+leave_window_group (GtkScrollbar *scrollbar)
 {
-  GtkScrollbar *scrollbar;
   OsScrollbarPrivate *priv;
+  OsToplevel *toplevel;
+  GtkWidget *widget;
 
-  scrollbar = GTK_SCROLLBAR (user_data);
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  priv->event = OS_EVENT_NONE;
-  priv->hidable_thumb = TRUE;
-  priv->state &= OS_STATE_FULLSIZE;
+  if (priv->window_group == NULL)
+    return;
 
-  /* Remove running hide timeout, if there is one. */
-  if (priv->source_hide_thumb_id != 0)
+  widget = gtk_widget_get_toplevel (GTK_WIDGET (scrollbar));
+  toplevel = g_object_get_qdata (G_OBJECT (widget), os_quark_toplevel);
+
+  if (toplevel != NULL &&
+      toplevel->window_group == priv->window_group &&
+      --toplevel->window_group_users == 0)
     {
-      g_source_remove (priv->source_hide_thumb_id);
-      priv->source_hide_thumb_id = 0;
+      /* The application might have moved the toplevel to its own group. */
+      if (gtk_window_get_group (GTK_WINDOW (widget)) == toplevel->window_group)
+        gtk_window_group_remove_window (toplevel->window_group, GTK_WINDOW (widget));
+
+      g_object_unref (toplevel->window_group);
+      toplevel->window_group = NULL;
     }
 
-  /* This could hardly still be running,
-   * but it is not impossible. */
-  if (priv->source_show_thumb_id != 0)
+  g_object_unref (priv->window_group);
+  priv->window_group = NULL;
+}
+
+/* Get the origin of the window of the scrollbar in root coordinates,
+ * using the origin cached for its toplevel instead of a round trip. */
+static void
+get_window_origin (GtkScrollbar *scrollbar,
+                   gint         *x,
+                   gint         *y)
+{
+  GdkWindow *toplevel_window;
+  GdkWindow *window;
+  GtkWidget *toplevel;
+  OsToplevel *origin;
+  gint x_pos, y_pos;
+
+  window = gtk_widget_get_window (GTK_WIDGET (scrollbar));
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (scrollbar));
+
+  /* Embedded toplevels don't get configure events when their embedder moves. */
+  if (!GTK_IS_WINDOW (toplevel) || GTK_IS_PLUG (toplevel))
     {
-      g_source_remove (priv->source_show_thumb_id);
-      priv->source_show_thumb_id = 0;
+      gdk_window_get_origin (window, x, y);
+      return;
     }
 
-  os_bar_set_detached (priv->bar, FALSE, TRUE);
-}
+  origin = get_toplevel (toplevel);
 
-/* Toplevel functions. */
+  toplevel_window = gtk_widget_get_window (toplevel);
 
-static gboolean
-toplevel_configure_event_cb (GtkWidget         *widget,
-                             GdkEventConfigure *event,
-                             gpointer           user_data)
-{
-  GtkScrollbar *scrollbar = GTK_SCROLLBAR (user_data);
-  OsScrollbarPrivate *priv = get_private (GTK_WIDGET (scrollbar));
-  const gint64 current_time = g_get_monotonic_time ();
-  const gint64 end_time = priv->present_time + TIMEOUT_PRESENT_WINDOW * 1000;
+  if (!origin->valid)
+    {
+      gdk_window_get_origin (toplevel_window, &origin->x, &origin->y);
+      origin->valid = TRUE;
+    }
 
-  if (current_time > end_time)
-    gtk_widget_hide (priv->thumb);
+  *x = origin->x;
+  *y = origin->y;
+
+  /* Gdk keeps the positions of the child windows,
+   * add them up to the toplevel without asking the server. */
+  while (window != toplevel_window)
+    {
+      if (window == NULL)
+        {
+          gdk_window_get_origin (gtk_widget_get_window (GTK_WIDGET (scrollbar)), x, y);
+          return;
+        }
 
-  priv->state &= ~(OS_STATE_LOCKED);
+      gdk_window_get_position (window, &x_pos, &y_pos);
 
-  calc_layout_bar (scrollbar, gtk_adjustment_get_value (priv->adjustment));
-  calc_layout_slider (scrollbar, gtk_adjustment_get_value (priv->adjustment));
+      *x += x_pos;
+      *y += y_pos;
 
-  return FALSE;
+      window = gdk_window_get_parent (window);
+    }
 }
 
 /* widget's window functions. */
@@ -2414,13 +3866,13 @@ adjust_thumb_position (GtkScrollbar *scrollbar,
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  gdk_window_get_origin (gtk_widget_get_window (GTK_WIDGET (scrollbar)), &x_pos, &y_pos);
+  get_window_origin (scrollbar, &x_pos, &y_pos);
 
   if (priv->state & OS_STATE_LOCKED)
     {
       gint x_pos_t, y_pos_t;
 
-      gdk_window_get_origin (gtk_widget_get_window (priv->thumb), &x_pos_t, &y_pos_t);
+      os_thumb_get_position (OS_THUMB (priv->thumb), &x_pos_t, &y_pos_t);
 
       /* If the pointer is moving in the area of the proximity
        * at the left of the thumb (so, not vertically intercepting the thumb),
@@ -2574,7 +4026,7 @@ check_proximity (GtkScrollbar *scrollbar,
     {
       gint x_pos, y_pos;
 
-      gdk_window_get_origin (gtk_widget_get_window (priv->thumb), &x_pos, &y_pos);
+      os_thumb_get_position (OS_THUMB (priv->thumb), &x_pos, &y_pos);
 
       /* This absolute value to add is obtained subtracting
        * the real position of the thumb from the theoretical position.
@@ -2619,16 +4071,45 @@ check_proximity (GtkScrollbar *scrollbar,
   return FALSE;
 }
 
+/* Get the mode of the scrollbar, the previous mode
+ * if a mode switch didn't reach it yet. */
+static ScrollbarMode
+get_scrollbar_mode (GtkWidget *widget)
+{
+  if (mode_switch.pending != NULL &&
+      g_hash_table_lookup (mode_switch.pending, widget) != NULL)
+    return mode_switch.previous_mode;
+
+  return scrollbar_mode;
+}
+
 /* Returns TRUE if touch mode is enabled. */
 static gboolean
 is_touch_mode (GtkWidget *widget,
                gint       device_id)
 {
-  return scrollbar_mode == SCROLLBAR_MODE_OVERLAY_TOUCH;
+  return get_scrollbar_mode (widget) == SCROLLBAR_MODE_OVERLAY_TOUCH;
+}
+
+/* Show the thumb window, logging the show latency. */
+static void
+show_thumb_window (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  gint64 start_time;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  start_time = g_get_monotonic_time ();
+
+  gtk_widget_show (get_thumb (scrollbar));
+
+  OS_LOG (OS_INFO, "thumb shown in %" G_GINT64_FORMAT " us",
+          g_get_monotonic_time () - start_time);
 }
 
 /* Callback that shows the thumb if it's the case. */
-static gboolean
+static void
 show_thumb_cb (gpointer user_data)
 {
   GtkScrollbar *scrollbar;
@@ -2639,14 +4120,10 @@ show_thumb_cb (gpointer user_data)
 
   if (!priv->hidable_thumb)
     {
-      gtk_widget_show (priv->thumb);
+      show_thumb_window (scrollbar);
 
       update_tail (scrollbar);
     }
-
-  priv->source_show_thumb_id = 0;
-
-  return FALSE;
 }
 
 /* Adds a timeout to reveal the thumb. */
@@ -2658,7 +4135,7 @@ show_thumb (GtkScrollbar *scrollbar)
   priv = get_private (GTK_WIDGET (scrollbar));
 
   /* Just update the tail if the thumb is already mapped. */
-  if (gtk_widget_get_mapped (priv->thumb))
+  if (is_thumb_mapped (priv))
     {
       update_tail (scrollbar);
       return;
@@ -2669,23 +4146,17 @@ show_thumb (GtkScrollbar *scrollbar)
       /* If the scrollbar is close to one edge of the screen,
        * show it immediately, ignoring the timeout,
        * to preserve Fitts' law. */
-      if (priv->source_show_thumb_id != 0)
-        {
-          g_source_remove (priv->source_show_thumb_id);
-          priv->source_show_thumb_id = 0;
-        }
+      os_timer_cancel (&priv->show_thumb_timer);
 
-      gtk_widget_show (priv->thumb);
+      show_thumb_window (scrollbar);
 
       update_tail (scrollbar);
     }
-  else if (priv->source_show_thumb_id == 0)
-    priv->source_show_thumb_id = g_timeout_add (TIMEOUT_THUMB_SHOW,
-                                                show_thumb_cb,
-                                                scrollbar);
+  else if (!os_timer_is_pending (&priv->show_thumb_timer))
+    os_timer_schedule (&priv->show_thumb_timer, TIMEOUT_THUMB_SHOW);
 }
 
-/* Filter function applied to the toplevel window. */
+/* Window filter functions. */
 typedef enum
 {
   OS_XEVENT_NONE,
@@ -2695,173 +4166,452 @@ typedef enum
   OS_XEVENT_MOTION
 } OsXEvent;
 
-static GdkFilterReturn
-window_filter_func (GdkXEvent *gdkxevent,
-                    GdkEvent  *event,
-                    gpointer   user_data)
+/* Handle an event of the window for a scrollbar,
+ * proximity is only meaningful for button release and motion. */
+static void
+scrollbar_window_event (GtkScrollbar *scrollbar,
+                        OsXEvent      os_xevent,
+                        gdouble       event_x,
+                        gdouble       event_y,
+                        gboolean      proximity)
 {
-  GtkScrollbar *scrollbar;
   OsScrollbarPrivate *priv;
-  XEvent *xev;
-
-  g_return_val_if_fail (GTK_IS_SCROLLBAR (user_data), GDK_FILTER_CONTINUE);
+  gint sourceid;
 
-  scrollbar = GTK_SCROLLBAR (user_data);
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  xev = gdkxevent;
+  sourceid = 0;
 
-  g_return_val_if_fail (OS_IS_BAR (priv->bar), GDK_FILTER_CONTINUE);
-  g_return_val_if_fail (OS_IS_THUMB (priv->thumb), GDK_FILTER_CONTINUE);
+  if (os_xevent == OS_XEVENT_BUTTON_PRESS)
+    {
+      priv->window_button_press = TRUE;
 
-  if (!(priv->state & OS_STATE_FULLSIZE))
+      os_timer_cancel (&priv->show_thumb_timer);
+
+      hide_thumb_window (scrollbar);
+    }
+
+  if (priv->window_button_press && os_xevent == OS_XEVENT_BUTTON_RELEASE)
+    {
+      priv->window_button_press = FALSE;
+
+      /* Proximity area. */
+      if (proximity)
+        {
+          priv->hidable_thumb = FALSE;
+
+          adjust_thumb_position (scrollbar, event_x, event_y);
+
+          if (priv->state & OS_STATE_LOCKED)
+            return;
+
+          if (!is_touch_mode (GTK_WIDGET (scrollbar), sourceid) && !priv->resizing_paned)
+            show_thumb (scrollbar);
+        }
+    }
+
+  if (os_xevent == OS_XEVENT_LEAVE)
+    {
+      priv->window_button_press = FALSE;
+
+      if (is_thumb_mapped (priv) &&
+          !(priv->event & OS_EVENT_BUTTON_PRESS))
+        {
+          priv->hidable_thumb = TRUE;
+
+          os_timer_schedule (&priv->hide_thumb_timer, TIMEOUT_TOPLEVEL_HIDE);
+        }
+
+      os_timer_cancel (&priv->show_thumb_timer);
+
+      os_timer_schedule (&priv->unlock_thumb_timer, TIMEOUT_TOPLEVEL_HIDE);
+    }
+
+  /* Get the motion_notify_event trough XEvent. */
+  if (!priv->window_button_press && os_xevent == OS_XEVENT_MOTION)
     {
-      OsXEvent os_xevent;
-      gdouble event_x, event_y;
-      gint sourceid;
+      /* Proximity area. */
+      if (proximity)
+        {
+          priv->hidable_thumb = FALSE;
+
+          os_timer_cancel (&priv->hide_thumb_timer);
+
+          adjust_thumb_position (scrollbar, event_x, event_y);
+
+          if (priv->state & OS_STATE_LOCKED)
+            return;
+
+          if (!is_touch_mode (GTK_WIDGET (scrollbar), sourceid) && !priv->resizing_paned)
+            show_thumb (scrollbar);
+        }
+      else
+        {
+          priv->state &= ~(OS_STATE_LOCKED);
+
+          os_timer_cancel (&priv->show_thumb_timer);
+
+          /* The thumb won't show, stop watching the workarea. */
+          if (!is_thumb_mapped (priv))
+            unwatch_workarea (scrollbar);
+
+          if (is_thumb_mapped (priv) &&
+              !(priv->event & OS_EVENT_BUTTON_PRESS))
+            {
+              priv->hidable_thumb = TRUE;
+
+              if (!os_timer_is_pending (&priv->hide_thumb_timer))
+                os_timer_schedule (&priv->hide_thumb_timer, TIMEOUT_PROXIMITY_HIDE);
+            }
+        }
+    }
+}
+
+/* Check if a motion outside the proximity area has something to undo,
+ * a scrollbar with a hidden and unlocked thumb can ignore it. */
+static gboolean
+scrollbar_tracks_motion (OsScrollbarPrivate *priv)
+{
+  return (priv->state & OS_STATE_LOCKED) ||
+         os_timer_is_pending (&priv->show_thumb_timer) ||
+         is_thumb_mapped (priv);
+}
+
+/* Get the cell of the proximity grid containing a coordinate. */
+static gint
+grid_cell (gint coordinate)
+{
+  if (coordinate >= 0)
+    return coordinate / PROXIMITY_CELL_SIZE;
+
+  return (coordinate - PROXIMITY_CELL_SIZE + 1) / PROXIMITY_CELL_SIZE;
+}
+
+/* Get the key of a cell of the proximity grid. */
+static gpointer
+grid_key (gint cell_x,
+          gint cell_y)
+{
+  return GUINT_TO_POINTER (((guint) (cell_y & 0xffff) << 16) | (guint) (cell_x & 0xffff));
+}
+
+/* Insert the scrollbar in the cells of the proximity grid
+ * covered by its proximity area. */
+static void
+grid_insert (OsWindowDispatcher *dispatcher,
+             GtkScrollbar       *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  gint margin;
+  gint x, y;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  /* Be conservative, the proximity area grows by up to
+   * the thumb width when the thumb is internal. */
+  margin = PROXIMITY_SIZE + THUMB_WIDTH;
 
-      os_xevent = OS_XEVENT_NONE;
+  priv->filter.cells.x = grid_cell (priv->bar_all.x - margin);
+  priv->filter.cells.y = grid_cell (priv->bar_all.y - margin);
+  priv->filter.cells.width = grid_cell (priv->bar_all.x + priv->bar_all.width + margin) - priv->filter.cells.x + 1;
+  priv->filter.cells.height = grid_cell (priv->bar_all.y + priv->bar_all.height + margin) - priv->filter.cells.y + 1;
+
+  for (y = priv->filter.cells.y; y < priv->filter.cells.y + priv->filter.cells.height; y++)
+    {
+      for (x = priv->filter.cells.x; x < priv->filter.cells.x + priv->filter.cells.width; x++)
+        {
+          GSList *cell;
 
-      event_x = 0;
-      event_y = 0;
+          cell = g_hash_table_lookup (dispatcher->grid, grid_key (x, y));
+          cell = g_slist_prepend (cell, scrollbar);
+          g_hash_table_insert (dispatcher->grid, grid_key (x, y), cell);
+        }
+    }
+}
 
-      sourceid = 0;
+/* Remove the scrollbar from the cells of the proximity grid. */
+static void
+grid_remove (OsWindowDispatcher *dispatcher,
+             GtkScrollbar       *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  gint x, y;
 
-      /* Deal with X core events, when apps (like rhythmbox),
-       * are using gdk_disable_miltidevice (). */
-      if (xev->type == ButtonPress)
-        os_xevent = OS_XEVENT_BUTTON_PRESS;
+  priv = get_private (GTK_WIDGET (scrollbar));
 
-      if (xev->type == ButtonRelease)
+  for (y = priv->filter.cells.y; y < priv->filter.cells.y + priv->filter.cells.height; y++)
+    {
+      for (x = priv->filter.cells.x; x < priv->filter.cells.x + priv->filter.cells.width; x++)
         {
-          os_xevent = OS_XEVENT_BUTTON_RELEASE;
-          event_x = xev->xbutton.x;
-          event_y = xev->xbutton.y;
+          GSList *cell;
+
+          cell = g_hash_table_lookup (dispatcher->grid, grid_key (x, y));
+          cell = g_slist_remove (cell, scrollbar);
+
+          if (cell != NULL)
+            g_hash_table_insert (dispatcher->grid, grid_key (x, y), cell);
+          else
+            g_hash_table_remove (dispatcher->grid, grid_key (x, y));
         }
+    }
+
+  priv->filter.cells.width = 0;
+  priv->filter.cells.height = 0;
+}
+
+/* Keep the list of scrollbars tracking the motion up to date. */
+static void
+update_tracking (OsWindowDispatcher *dispatcher,
+                 GtkScrollbar       *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  gboolean tracking;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  tracking = scrollbar_tracks_motion (priv);
+
+  if (tracking == priv->filter.tracking)
+    return;
+
+  priv->filter.tracking = tracking;
+
+  if (tracking)
+    dispatcher->tracking = g_slist_prepend (dispatcher->tracking, scrollbar);
+  else
+    dispatcher->tracking = g_slist_remove (dispatcher->tracking, scrollbar);
+}
+
+/* Dispatch a motion to a scrollbar, once for each event. */
+static void
+dispatch_motion (OsWindowDispatcher *dispatcher,
+                 GtkScrollbar       *scrollbar,
+                 gdouble             event_x,
+                 gdouble             event_y)
+{
+  OsScrollbarPrivate *priv;
+  gboolean proximity;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (priv->filter.serial == dispatcher->serial)
+    return;
+
+  priv->filter.serial = dispatcher->serial;
+
+  flush_update (scrollbar);
+
+  if ((priv->state & OS_STATE_FULLSIZE) ||
+      priv->window_button_press)
+    return;
+
+  proximity = check_proximity (scrollbar, event_x, event_y);
+
+  if (!proximity && !scrollbar_tracks_motion (priv))
+    return;
+
+  scrollbar_window_event (scrollbar, OS_XEVENT_MOTION, event_x, event_y, proximity);
+
+  update_tracking (dispatcher, scrollbar);
+}
+
+/* Dispatch a motion to the scrollbars of the window. */
+static void
+dispatch_motions (OsWindowDispatcher *dispatcher,
+                  gdouble             event_x,
+                  gdouble             event_y)
+{
+  GSList *list, *next;
+
+  /* Only the scrollbars in the cell of the pointer can have it
+   * in their proximity area, then the ones tracking the motion. */
+  dispatcher->serial++;
+
+  list = g_hash_table_lookup (dispatcher->grid,
+                              grid_key (grid_cell (event_x), grid_cell (event_y)));
+
+  for (; list != NULL; list = next)
+    {
+      /* The handler could remove the scrollbar from the list. */
+      next = list->next;
+
+      dispatch_motion (dispatcher, GTK_SCROLLBAR (list->data), event_x, event_y);
+    }
+
+  for (list = dispatcher->tracking; list != NULL; list = next)
+    {
+      next = list->next;
+
+      dispatch_motion (dispatcher, GTK_SCROLLBAR (list->data), event_x, event_y);
+    }
+}
+
+/* Handle the latest motion of the frame, if any. */
+static gboolean
+motion_frame_cb (gpointer user_data)
+{
+  OsWindowDispatcher *dispatcher;
+
+  dispatcher = user_data;
+
+  if (!dispatcher->motion_pending)
+    {
+      /* The pointer stopped, the next motion is handled right away. */
+      dispatcher->source_motion_id = 0;
+
+      return FALSE;
+    }
+
+  dispatcher->motion_pending = FALSE;
+
+  dispatch_motions (dispatcher, dispatcher->motion.x, dispatcher->motion.y);
+
+  return TRUE;
+}
+
+/* Filter function applied to the window,
+ * dispatching its events to the scrollbars inside it. */
+static GdkFilterReturn
+window_filter_func (GdkXEvent *gdkxevent,
+                    GdkEvent  *event,
+                    gpointer   user_data)
+{
+  GSList *list, *next;
+  OsWindowDispatcher *dispatcher;
+  OsXEvent os_xevent;
+  XEvent *xev;
+  gdouble event_x, event_y;
+
+  dispatcher = user_data;
+
+  xev = gdkxevent;
+
+  os_xevent = OS_XEVENT_NONE;
+
+  event_x = 0;
+  event_y = 0;
+
+  /* Deal with X core events, when apps (like rhythmbox),
+   * are using gdk_disable_miltidevice (). */
+  if (xev->type == ButtonPress)
+    os_xevent = OS_XEVENT_BUTTON_PRESS;
+
+  if (xev->type == ButtonRelease)
+    {
+      os_xevent = OS_XEVENT_BUTTON_RELEASE;
+      event_x = xev->xbutton.x;
+      event_y = xev->xbutton.y;
+    }
+
+  if (xev->type == LeaveNotify)
+    os_xevent = OS_XEVENT_LEAVE;
 
-      if (xev->type == LeaveNotify)
-        os_xevent = OS_XEVENT_LEAVE;
+  if (xev->type == MotionNotify)
+    {
+      os_xevent = OS_XEVENT_MOTION;
+      event_x = xev->xmotion.x;
+      event_y = xev->xmotion.y;
+    }
 
-      if (xev->type == MotionNotify)
-        {
-          os_xevent = OS_XEVENT_MOTION;
-          event_x = xev->xmotion.x;
-          event_y = xev->xmotion.y;
-        }
+  if (os_xevent == OS_XEVENT_NONE)
+    return GDK_FILTER_CONTINUE;
 
-      if (os_xevent == OS_XEVENT_BUTTON_PRESS)
+  if (os_xevent == OS_XEVENT_MOTION)
+    {
+      /* Handle a motion right away, then only the latest one
+       * for each frame, the ones in between would be overwritten. */
+      if (dispatcher->source_motion_id == 0)
         {
-          priv->window_button_press = TRUE;
-
-          if (priv->source_show_thumb_id != 0)
-            {
-              g_source_remove (priv->source_show_thumb_id);
-              priv->source_show_thumb_id = 0;
-            }
+          dispatch_motions (dispatcher, event_x, event_y);
 
-          gtk_widget_hide (priv->thumb);
+          dispatcher->source_motion_id = g_timeout_add (RATE_MOTION,
+                                                        motion_frame_cb,
+                                                        dispatcher);
         }
-
-      if (priv->window_button_press && os_xevent == OS_XEVENT_BUTTON_RELEASE)
+      else
         {
-          priv->window_button_press = FALSE;
-
-          /* Proximity area. */
-          if (check_proximity (scrollbar, event_x, event_y))
-            {
-              priv->hidable_thumb = FALSE;
-
-              adjust_thumb_position (scrollbar, event_x, event_y);
+          dispatcher->motion.x = event_x;
+          dispatcher->motion.y = event_y;
+          dispatcher->motion_pending = TRUE;
+        }
 
-              if (priv->state & OS_STATE_LOCKED)
-                return GDK_FILTER_CONTINUE;
+      return GDK_FILTER_CONTINUE;
+    }
 
-              if (!is_touch_mode (GTK_WIDGET (scrollbar), sourceid) && !priv->resizing_paned)
-                show_thumb (scrollbar);
-            }
-        }
+  /* Buttons and leave are handled immediately,
+   * after the motion that preceded them. */
+  if (dispatcher->motion_pending)
+    {
+      dispatcher->motion_pending = FALSE;
+      dispatch_motions (dispatcher, dispatcher->motion.x, dispatcher->motion.y);
+    }
 
-      if (os_xevent == OS_XEVENT_LEAVE)
-        {
-          priv->window_button_press = FALSE;
+  for (list = dispatcher->scrollbars.head; list != NULL; list = next)
+    {
+      GtkScrollbar *scrollbar;
+      OsScrollbarPrivate *priv;
+      gboolean proximity;
 
-          if (gtk_widget_get_mapped (priv->thumb) &&
-              !(priv->event & OS_EVENT_BUTTON_PRESS))
-            {
-              priv->hidable_thumb = TRUE;
+      next = list->next;
 
-              if (priv->source_hide_thumb_id != 0)
-                g_source_remove (priv->source_hide_thumb_id);
+      scrollbar = GTK_SCROLLBAR (list->data);
+      priv = get_private (GTK_WIDGET (scrollbar));
 
-              priv->source_hide_thumb_id = g_timeout_add (TIMEOUT_TOPLEVEL_HIDE,
-                                                          hide_thumb_cb,
-                                                          scrollbar);
-            }
+      flush_update (scrollbar);
 
-          if (priv->source_show_thumb_id != 0)
-            {
-              g_source_remove (priv->source_show_thumb_id);
-              priv->source_show_thumb_id = 0;
-            }
+      if (priv->state & OS_STATE_FULLSIZE)
+        continue;
 
-          if (priv->source_unlock_thumb_id != 0)
-            g_source_remove (priv->source_unlock_thumb_id);
+      proximity = FALSE;
 
-          priv->source_unlock_thumb_id = g_timeout_add (TIMEOUT_TOPLEVEL_HIDE,
-                                                        unlock_thumb_cb,
-                                                        scrollbar);
-        }
+      if (os_xevent == OS_XEVENT_BUTTON_RELEASE && priv->window_button_press)
+        proximity = check_proximity (scrollbar, event_x, event_y);
 
-      /* Get the motion_notify_event trough XEvent. */
-      if (!priv->window_button_press && os_xevent == OS_XEVENT_MOTION)
-        {
-          /* Proximity area. */
-          if (check_proximity (scrollbar, event_x, event_y))
-            {
-              priv->hidable_thumb = FALSE;
+      scrollbar_window_event (scrollbar, os_xevent, event_x, event_y, proximity);
 
-              if (priv->source_hide_thumb_id != 0)
-                {
-                  g_source_remove (priv->source_hide_thumb_id);
-                  priv->source_hide_thumb_id = 0;
-                }
+      update_tracking (dispatcher, scrollbar);
+    }
 
-              adjust_thumb_position (scrollbar, event_x, event_y);
+  return GDK_FILTER_CONTINUE;
+}
 
-              if (priv->state & OS_STATE_LOCKED)
-                return GDK_FILTER_CONTINUE;
+/* Free a cell of the proximity grid. */
+static void
+grid_cell_free (gpointer key,
+                gpointer value,
+                gpointer user_data)
+{
+  g_slist_free (value);
+}
 
-              if (!is_touch_mode (GTK_WIDGET (scrollbar), sourceid) && !priv->resizing_paned)
-                show_thumb (scrollbar);
-            }
-          else
-            {
-              priv->state &= ~(OS_STATE_LOCKED);
+/* Free the dispatcher of a window. */
+static void
+window_dispatcher_free (gpointer data)
+{
+  OsWindowDispatcher *dispatcher;
 
-              if (priv->source_show_thumb_id != 0)
-                {
-                  g_source_remove (priv->source_show_thumb_id);
-                  priv->source_show_thumb_id = 0;
-                }
+  dispatcher = data;
 
-              if (gtk_widget_get_mapped (priv->thumb) &&
-                  !(priv->event & OS_EVENT_BUTTON_PRESS))
-                {
-                  priv->hidable_thumb = TRUE;
+  if (dispatcher->source_motion_id != 0)
+    g_source_remove (dispatcher->source_motion_id);
 
-                  if (priv->source_hide_thumb_id == 0)
-                    priv->source_hide_thumb_id = g_timeout_add (TIMEOUT_PROXIMITY_HIDE,
-                                                                hide_thumb_cb,
-                                                                scrollbar);
-                }
-            }
-        }
-    }
+  g_hash_table_foreach (dispatcher->grid, grid_cell_free, NULL);
+  g_hash_table_destroy (dispatcher->grid);
+  registry_clear (&dispatcher->scrollbars);
+  g_slist_free (dispatcher->tracking);
+  g_slice_free (OsWindowDispatcher, dispatcher);
+}
 
-  return GDK_FILTER_CONTINUE;
+/* Get the dispatcher of the window of the scrollbar. */
+static OsWindowDispatcher*
+get_window_dispatcher (GtkScrollbar *scrollbar)
+{
+  return g_object_get_qdata (G_OBJECT (gtk_widget_get_window (GTK_WIDGET (scrollbar))),
+                             os_quark_dispatcher);
 }
 
-/* Add the window filter function. */
+/* Add the scrollbar to the window filter function,
+ * installed once for each window. */
 static void
 add_window_filter (GtkScrollbar *scrollbar)
 {
@@ -2873,14 +4623,34 @@ add_window_filter (GtkScrollbar *scrollbar)
   if (!priv->filter.running &&
       gtk_widget_get_realized (GTK_WIDGET (scrollbar)))
     {
+      GdkWindow *window;
+      OsWindowDispatcher *dispatcher;
+
+      window = gtk_widget_get_window (GTK_WIDGET (scrollbar));
+
+      dispatcher = get_window_dispatcher (scrollbar);
+
+      if (dispatcher == NULL)
+        {
+          dispatcher = g_slice_new0 (OsWindowDispatcher);
+          dispatcher->grid = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+          g_object_set_qdata_full (G_OBJECT (window), os_quark_dispatcher,
+                                   dispatcher, window_dispatcher_free);
+
+          gdk_window_add_filter (window, window_filter_func, dispatcher);
+        }
+
       priv->filter.running = TRUE;
-      gdk_window_add_filter (gtk_widget_get_window (GTK_WIDGET (scrollbar)),
-                             window_filter_func,
-                             scrollbar);
+      registry_link (&dispatcher->scrollbars, &priv->dispatcher_link, scrollbar);
+
+      grid_insert (dispatcher, scrollbar);
+      update_tracking (dispatcher, scrollbar);
     }
 }
 
-/* Remove the window filter function. */
+/* Remove the scrollbar from the window filter function,
+ * removing the filter with the last scrollbar. */
 static void
 remove_window_filter (GtkScrollbar *scrollbar)
 {
@@ -2892,207 +4662,395 @@ remove_window_filter (GtkScrollbar *scrollbar)
   if (priv->filter.running &&
       gtk_widget_get_realized (GTK_WIDGET (scrollbar)))
     {
+      GdkWindow *window;
+      OsWindowDispatcher *dispatcher;
+
+      window = gtk_widget_get_window (GTK_WIDGET (scrollbar));
+
+      dispatcher = get_window_dispatcher (scrollbar);
+
       priv->filter.running = FALSE;
-      gdk_window_remove_filter (gtk_widget_get_window (GTK_WIDGET (scrollbar)),
-                                window_filter_func,
-                                scrollbar);
+
+      if (dispatcher == NULL)
+        return;
+
+      grid_remove (dispatcher, scrollbar);
+
+      if (priv->filter.tracking)
+        {
+          priv->filter.tracking = FALSE;
+          dispatcher->tracking = g_slist_remove (dispatcher->tracking, scrollbar);
+        }
+
+      registry_unlink (&priv->dispatcher_link);
+
+      if (g_queue_is_empty (&dispatcher->scrollbars))
+        {
+          gdk_window_remove_filter (window, window_filter_func, dispatcher);
+
+          /* Frees the dispatcher. */
+          g_object_set_qdata (G_OBJECT (window), os_quark_dispatcher, NULL);
+        }
     }
 }
 
+/* Move the scrollbar in the proximity grid after an allocation. */
+static void
+update_window_filter (GtkScrollbar *scrollbar)
+{
+  OsScrollbarPrivate *priv;
+  OsWindowDispatcher *dispatcher;
+
+  priv = get_private (GTK_WIDGET (scrollbar));
+
+  if (!priv->filter.running)
+    return;
+
+  dispatcher = get_window_dispatcher (scrollbar);
+
+  if (dispatcher == NULL)
+    return;
+
+  grid_remove (dispatcher, scrollbar);
+  grid_insert (dispatcher, scrollbar);
+}
+
+static gboolean
+use_overlay_scrollbar (GtkWidget *widget)
+{
+  return get_scrollbar_mode (widget) != SCROLLBAR_MODE_NORMAL && ubuntu_gtk_get_use_overlay_scrollbar ();
+}
+
+/* Return TRUE if the application opted out of the overlay scrollbars,
+ * as recorded at realize, see overlay_vtable_realize (). */
 static gboolean
-use_overlay_scrollbar (void)
+use_native_scrollbar (GtkWidget *widget)
 {
-  return scrollbar_mode != SCROLLBAR_MODE_NORMAL && ubuntu_gtk_get_use_overlay_scrollbar ();
+  OsScrollbarPrivate *priv;
+
+  priv = lookup_private (widget);
+
+  return priv != NULL && priv->use_native;
 }
 
 static void
-hijacked_scrollbar_dispose (GObject *object)
+overlay_scrollbar_dispose (GObject *object)
 {
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
-      OsScrollbarPrivate *priv;
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
 
-      scrollbar = GTK_SCROLLBAR (object);
+  scrollbar = GTK_SCROLLBAR (object);
 
-      os_root_list = g_slist_remove (os_root_list, scrollbar);
+  g_hash_table_remove (os_root_table, scrollbar);
 
-      if (os_root_list == NULL)
+  if (g_hash_table_size (os_root_table) == 0)
+    {
+      if (os_workarea != NULL)
         {
-          if (os_workarea != NULL)
-            {
-              cairo_region_destroy (os_workarea);
-              os_workarea = NULL;
-            }
-
-          gdk_window_remove_filter (gdk_get_default_root_window (),
-                                    root_filter_func, NULL);
+          cairo_region_destroy (os_workarea);
+          os_workarea = NULL;
         }
 
-      priv = lookup_private (GTK_WIDGET(scrollbar));
-      if (priv != NULL)
+      if (os_monitors_screen != NULL)
         {
-          if (priv->source_deactivate_bar_id != 0)
-            {
-              g_source_remove (priv->source_deactivate_bar_id);
-              priv->source_deactivate_bar_id = 0;
-            }
+          g_signal_handlers_disconnect_by_func (os_monitors_screen,
+                                                G_CALLBACK (monitors_changed_cb), NULL);
+          os_monitors_screen = NULL;
+        }
 
-          if (priv->source_hide_thumb_id != 0)
-            {
-              g_source_remove (priv->source_hide_thumb_id);
-              priv->source_hide_thumb_id = 0;
-            }
+      free_monitors ();
 
-          if (priv->source_show_thumb_id != 0)
-            {
-              g_source_remove (priv->source_show_thumb_id);
-              priv->source_show_thumb_id = 0;
-            }
+      g_free (os_workarea_values);
+      os_workarea_values = NULL;
+      os_workarea_n_values = 0;
+      os_workarea_fetched = FALSE;
 
-          if (priv->source_unlock_thumb_id != 0)
-            {
-              g_source_remove (priv->source_unlock_thumb_id);
-              priv->source_unlock_thumb_id = 0;
-            }
+      if (source_workarea_id != 0)
+        {
+          g_source_remove (source_workarea_id);
+          source_workarea_id = 0;
+        }
+    }
 
-          if (priv->animation != NULL)
-            {
-              g_object_unref (priv->animation);
-              priv->animation = NULL;
-            }
+  priv = lookup_private (GTK_WIDGET(scrollbar));
+  if (priv != NULL)
+    {
+      os_timer_cancel (&priv->hide_thumb_timer);
+      os_timer_cancel (&priv->show_thumb_timer);
+      os_timer_cancel (&priv->unlock_thumb_timer);
 
-          if (priv->bar != NULL)
-            {
-              g_object_unref (priv->bar);
-              priv->bar = NULL;
-            }
+      cancel_drag (scrollbar);
+      cancel_wheel (scrollbar);
+      unwatch_workarea (scrollbar);
 
-          if (priv->window_group != NULL)
-            {
-              g_object_unref (priv->window_group);
-              priv->window_group = NULL;
-            }
+      if (priv->source_update_id != 0)
+        {
+          g_source_remove (priv->source_update_id);
+          priv->source_update_id = 0;
+        }
+
+      if (priv->animation != NULL)
+        {
+          g_object_unref (priv->animation);
+          priv->animation = NULL;
+        }
 
-          swap_adjustment (scrollbar, NULL);
-          swap_thumb (scrollbar, NULL);
+      if (priv->bar != NULL)
+        {
+          g_object_unref (priv->bar);
+          priv->bar = NULL;
         }
+
+      leave_window_group (scrollbar);
+
+      registry_unlink (&priv->dispatcher_link);
+      registry_unlink (&priv->toplevel_link);
+
+      swap_adjustment (scrollbar, NULL);
+      swap_thumb (scrollbar, NULL);
     }
 
   (* pre_hijacked_scrollbar_dispose) (object);
 }
 
+static void
+hijacked_scrollbar_dispose (GObject *object)
+{
+  if (use_overlay_scrollbar (GTK_WIDGET (object)))
+    overlay_scrollbar_dispose (object);
+  else
+    (* pre_hijacked_scrollbar_dispose) (object);
+}
+
+static gboolean
+overlay_scrollbar_expose_event (GtkWidget      *widget,
+                                GdkEventExpose *event)
+{
+  /* The bar and the thumb draw the scrollbar. */
+  return TRUE;
+}
+
 static gboolean
 hijacked_scrollbar_expose_event (GtkWidget      *widget,
                                  GdkEventExpose *event)
 {
-  if (use_overlay_scrollbar ())
-    return TRUE;
+  if (use_overlay_scrollbar (widget))
+    return overlay_scrollbar_expose_event (widget, event);
 
   return (* pre_hijacked_scrollbar_expose_event) (widget, event);
 }
 
+static gboolean
+overlay_vtable_expose_event (GtkWidget      *widget,
+                             GdkEventExpose *event)
+{
+  if (use_native_scrollbar (widget))
+    return (* pre_hijacked_scrollbar_expose_event) (widget, event);
+
+  return overlay_scrollbar_expose_event (widget, event);
+}
+
+static void
+overlay_scrollbar_grab_notify (GtkWidget *widget,
+                               gboolean   was_grabbed)
+{
+  /* Grabs don't change the state of the scrollbar. */
+}
+
 static void
 hijacked_scrollbar_grab_notify (GtkWidget *widget,
                                 gboolean   was_grabbed)
 {
-  if (use_overlay_scrollbar ())
-    return;
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_grab_notify (widget, was_grabbed);
+  else
+    (* pre_hijacked_scrollbar_grab_notify) (widget, was_grabbed);
+}
 
-  (* pre_hijacked_scrollbar_grab_notify) (widget, was_grabbed);
+static void
+overlay_vtable_grab_notify (GtkWidget *widget,
+                            gboolean   was_grabbed)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_grab_notify) (widget, was_grabbed);
+  else
+    overlay_scrollbar_grab_notify (widget, was_grabbed);
 }
 
 static void
-hijacked_scrollbar_hide (GtkWidget *widget)
+overlay_scrollbar_hide (GtkWidget *widget)
 {
-  if (use_overlay_scrollbar ())
-    {
-      (* widget_class_hide) (widget);
+  (* widget_class_hide) (widget);
+}
 
-      return;
-    }
+static void
+hijacked_scrollbar_hide (GtkWidget *widget)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_hide (widget);
+  else
+    (* pre_hijacked_scrollbar_hide) (widget);
+}
 
-  (* pre_hijacked_scrollbar_hide) (widget);
+static void
+overlay_vtable_hide (GtkWidget *widget)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_hide) (widget);
+  else
+    overlay_scrollbar_hide (widget);
 }
 
 static void
-hijacked_scrollbar_map (GtkWidget *widget)
+overlay_scrollbar_map (GtkWidget *widget)
 {
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
-      OsScrollbarPrivate *priv;
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
 
-      scrollbar = GTK_SCROLLBAR (widget);
-      priv = get_private (widget);
+  scrollbar = GTK_SCROLLBAR (widget);
+  priv = get_private (widget);
 
-      (* widget_class_map) (widget);
+  (* widget_class_map) (widget);
 
-      if (!(priv->state & OS_STATE_FULLSIZE))
-        os_bar_show (priv->bar);
+  flush_update (scrollbar);
 
-      if (!is_insensitive (scrollbar))
-        {
-          priv->filter.proximity = TRUE;
-          add_window_filter (scrollbar);
-        }
+  if (!(priv->state & OS_STATE_FULLSIZE))
+    os_bar_show (priv->bar);
 
-      return;
+  if (!is_insensitive (scrollbar))
+    {
+      priv->filter.proximity = TRUE;
+      add_window_filter (scrollbar);
     }
+}
+
+static void
+hijacked_scrollbar_map (GtkWidget *widget)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_map (widget);
+  else
+    (* pre_hijacked_scrollbar_map) (widget);
+}
 
-  (* pre_hijacked_scrollbar_map) (widget);
+static void
+overlay_vtable_map (GtkWidget *widget)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_map) (widget);
+  else
+    overlay_scrollbar_map (widget);
 }
 
 static void
-hijacked_scrollbar_realize (GtkWidget *widget)
+overlay_scrollbar_realize (GtkWidget *widget)
 {
-  scrollbar_list = g_slist_prepend (scrollbar_list, widget);
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
+  OsToplevel *toplevel;
 
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
-      OsScrollbarPrivate *priv;
+  scrollbar = GTK_SCROLLBAR (widget);
+  priv = get_private (widget);
 
-      scrollbar = GTK_SCROLLBAR (widget);
-      priv = get_private (widget);
+  g_hash_table_insert (scrollbar_table, widget, widget);
 
-      (* widget_class_realize) (widget);
+  /* The bar needs a new allocation. */
+  priv->allocation_valid = FALSE;
 
-      gtk_window_group_add_window (priv->window_group, GTK_WINDOW (gtk_widget_get_toplevel (widget)));
+  (* widget_class_realize) (widget);
 
-      gdk_window_set_events (gtk_widget_get_window (widget),
-                             gdk_window_get_events (gtk_widget_get_window (widget)) |
-                             GDK_BUTTON_PRESS_MASK |
-                             GDK_BUTTON_RELEASE_MASK |
-                             GDK_POINTER_MOTION_MASK);
+  join_window_group (scrollbar);
 
-      if (priv->filter.proximity)
-        add_window_filter (scrollbar);
+  gdk_window_set_events (gtk_widget_get_window (widget),
+                         gdk_window_get_events (gtk_widget_get_window (widget)) |
+                         GDK_BUTTON_PRESS_MASK |
+                         GDK_BUTTON_RELEASE_MASK |
+                         GDK_POINTER_MOTION_MASK);
 
-      g_signal_connect (G_OBJECT (gtk_widget_get_toplevel (widget)), "configure-event",
-                        G_CALLBACK (toplevel_configure_event_cb), scrollbar);
+  if (priv->filter.proximity)
+    add_window_filter (scrollbar);
 
-      calc_layout_bar (scrollbar, gtk_adjustment_get_value (priv->adjustment));
+  toplevel = get_toplevel (gtk_widget_get_toplevel (widget));
+  registry_link (&toplevel->scrollbars, &priv->toplevel_link, scrollbar);
 
-      os_bar_set_parent (priv->bar, widget);
+  if (toplevel->suspended)
+    suspend_scrollbar (scrollbar);
 
-      return;
-    }
+  calc_layout (scrollbar, gtk_adjustment_get_value (priv->adjustment));
+
+  os_bar_set_parent (priv->bar, widget);
+}
+
+static void
+native_scrollbar_realize (GtkWidget *widget)
+{
+  g_hash_table_insert (scrollbar_table, widget, widget);
 
   (* pre_hijacked_scrollbar_realize) (widget);
 }
 
 static void
-hijacked_scrollbar_show (GtkWidget *widget)
+hijacked_scrollbar_realize (GtkWidget *widget)
 {
-  if (use_overlay_scrollbar ())
+  /* Record the choice for the overlay vtable, installed once the switch ends. */
+  if (use_overlay_scrollbar (widget))
+    {
+      get_private (widget)->use_native = FALSE;
+      overlay_scrollbar_realize (widget);
+    }
+  else
     {
-      (* widget_class_show) (widget);
+      if (get_scrollbar_mode (widget) != SCROLLBAR_MODE_NORMAL)
+        get_private (widget)->use_native = TRUE;
 
-      return;
+      native_scrollbar_realize (widget);
+    }
+}
+
+static void
+overlay_vtable_realize (GtkWidget *widget)
+{
+  OsScrollbarPrivate *priv;
+
+  priv = get_private (widget);
+
+  /* The application can opt out after gtk_init (),
+   * check it once here instead of in every vfunc. */
+  priv->use_native = !ubuntu_gtk_get_use_overlay_scrollbar ();
+
+  if (priv->use_native)
+    {
+      /* It was requested as an overlay scrollbar until now. */
+      gtk_widget_queue_resize (widget);
+
+      native_scrollbar_realize (widget);
     }
+  else
+    overlay_scrollbar_realize (widget);
+}
+
+static void
+overlay_scrollbar_show (GtkWidget *widget)
+{
+  (* widget_class_show) (widget);
+}
+
+static void
+hijacked_scrollbar_show (GtkWidget *widget)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_show (widget);
+  else
+    (* pre_hijacked_scrollbar_show) (widget);
+}
 
-  (* pre_hijacked_scrollbar_show) (widget);
+static void
+overlay_vtable_show (GtkWidget *widget)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_show) (widget);
+  else
+    overlay_scrollbar_show (widget);
 }
 
 /* Retrieve the side of the scrollbar. */
@@ -3139,52 +5097,144 @@ retrieve_side (GtkScrollbar *scrollbar)
     }
 }
 
-/* Retrieve if the thumb can resize its toplevel window. */
+/* Get the position of a window relative to the toplevel window,
+ * adding up the positions Gdk keeps for the child windows.
+ * Returns FALSE if it had to ask the server. */
+static gboolean
+get_window_offset (GdkWindow *window,
+                   GdkWindow *toplevel_window,
+                   gint      *x,
+                   gint      *y)
+{
+  GdkWindow *parent;
+  gint x_pos, y_pos;
+
+  *x = 0;
+  *y = 0;
+
+  for (parent = window; parent != toplevel_window; parent = gdk_window_get_parent (parent))
+    {
+      if (parent == NULL)
+        {
+          gint x_toplevel, y_toplevel;
+
+          gdk_window_get_origin (toplevel_window, &x_toplevel, &y_toplevel);
+          gdk_window_get_origin (window, x, y);
+
+          *x -= x_toplevel;
+          *y -= y_toplevel;
+
+          return FALSE;
+        }
+
+      gdk_window_get_position (parent, &x_pos, &y_pos);
+
+      *x += x_pos;
+      *y += y_pos;
+    }
+
+  return TRUE;
+}
+
+/* Check whether the geometries used to retrieve the resizability match. */
+static gboolean
+resize_geometry_equal (const OsResizeGeometry *a,
+                       const OsResizeGeometry *b)
+{
+  return a->valid && b->valid &&
+         a->side == b->side &&
+         a->thumb.x == b->thumb.x &&
+         a->thumb.y == b->thumb.y &&
+         a->toplevel_width == b->toplevel_width &&
+         a->toplevel_height == b->toplevel_height &&
+         a->handle.x == b->handle.x &&
+         a->handle.y == b->handle.y &&
+         a->handle.width == b->handle.width &&
+         a->handle.height == b->handle.height;
+}
+
+/* Retrieve if the thumb can resize its toplevel window,
+ * only if the geometry changed since the last time. */
 static void
 retrieve_resizability (GtkScrollbar *scrollbar)
 {
+  GdkWindow *handle_window;
   GdkWindow *scrollbar_window;
   GdkWindow *toplevel_window;
+  GtkPaned *paned;
+  OsResizeGeometry geometry;
   OsScrollbarPrivate *priv;
   gint x, y;
-  gint x_pos, y_pos;
 
   priv = get_private (GTK_WIDGET (scrollbar));
 
-  /* By default, they don't allow resize. */
-  priv->allow_resize = FALSE;
-
   scrollbar_window = gtk_widget_get_window (GTK_WIDGET (scrollbar));
 
   if (!scrollbar_window)
-    return;
+    {
+      /* By default, they don't allow resize. */
+      priv->allow_resize = FALSE;
+      priv->resize_geometry.valid = FALSE;
+      return;
+    }
 
   toplevel_window = gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (scrollbar)));
 
-  gdk_window_get_origin (toplevel_window, &x, &y);
+  paned = get_paned (scrollbar);
+  handle_window = paned != NULL ? gtk_paned_get_handle_window (paned) : NULL;
+
+  geometry.valid = get_window_offset (scrollbar_window, toplevel_window, &x, &y);
+  geometry.side = priv->side;
+  geometry.thumb.x = x + priv->thumb_all.x;
+  geometry.thumb.y = y + priv->thumb_all.y;
+  geometry.toplevel_width = gdk_window_get_width (toplevel_window);
+  geometry.toplevel_height = gdk_window_get_height (toplevel_window);
+
+  if (handle_window != NULL)
+    {
+      if (!get_window_offset (handle_window, toplevel_window, &geometry.handle.x, &geometry.handle.y))
+        geometry.valid = FALSE;
+
+      geometry.handle.width = gdk_window_get_width (handle_window);
+      geometry.handle.height = gdk_window_get_height (handle_window);
+    }
+  else
+    {
+      geometry.handle.x = 0;
+      geometry.handle.y = 0;
+      geometry.handle.width = 0;
+      geometry.handle.height = 0;
+    }
+
+  /* Nothing moved, the resizability is the same,
+   * unless a paned resize needs to be reset. */
+  if (!priv->resizing_paned &&
+      resize_geometry_equal (&geometry, &priv->resize_geometry))
+    return;
+
+  priv->resize_geometry = geometry;
 
-  gdk_window_get_root_coords (scrollbar_window,
-                              priv->thumb_all.x, priv->thumb_all.y,
-                              &x_pos, &y_pos);
+  /* By default, they don't allow resize. */
+  priv->allow_resize = FALSE;
 
   /* Check if the thumb is next to a window edge,
    * if that's the case, set the allow_resize gboolean. */
   switch (priv->side)
   {
     case OS_SIDE_RIGHT:
-      if (x + gdk_window_get_width (toplevel_window) - x_pos <= THUMB_WIDTH)
+      if (geometry.toplevel_width - geometry.thumb.x <= THUMB_WIDTH)
         priv->allow_resize = TRUE;
       break;
     case OS_SIDE_BOTTOM:
-      if (y + gdk_window_get_height (toplevel_window) - y_pos <= THUMB_WIDTH)
+      if (geometry.toplevel_height - geometry.thumb.y <= THUMB_WIDTH)
         priv->allow_resize = TRUE;
       break;
     case OS_SIDE_LEFT:
-      if (x_pos - x <= THUMB_WIDTH)
+      if (geometry.thumb.x <= THUMB_WIDTH)
         priv->allow_resize = TRUE;
       break;
     case OS_SIDE_TOP:
-      if (y_pos - y <= THUMB_WIDTH)
+      if (geometry.thumb.y <= THUMB_WIDTH)
         priv->allow_resize = TRUE;
       break;
     default:
@@ -3194,16 +5244,9 @@ retrieve_resizability (GtkScrollbar *scrollbar)
   if (priv->allow_resize)
     return;
 
-
-  GtkPaned* paned = find_gtk_paned_from_scrollbar(scrollbar);
-
   if (!paned)
     return;
 
-  GdkWindow *handle_window = gtk_paned_get_handle_window (paned);
-
-  gdk_window_get_origin (handle_window, &x, &y);
-
   priv->allow_resize_paned = FALSE;
   priv->resizing_paned = FALSE;
 
@@ -3212,19 +5255,19 @@ retrieve_resizability (GtkScrollbar *scrollbar)
   switch (priv->side)
   {
     case OS_SIDE_RIGHT:
-      if (x + gdk_window_get_width (handle_window) - x_pos <= THUMB_WIDTH)
+      if (geometry.handle.x + geometry.handle.width - geometry.thumb.x <= THUMB_WIDTH)
         priv->allow_resize_paned = TRUE;
       break;
     case OS_SIDE_LEFT:
-      if (x_pos - x <= THUMB_WIDTH)
+      if (geometry.thumb.x - geometry.handle.x <= THUMB_WIDTH)
         priv->allow_resize_paned = TRUE;
       break;
     case OS_SIDE_BOTTOM:
-      if (y + gdk_window_get_height (handle_window) - y_pos <= THUMB_WIDTH)
+      if (geometry.handle.y + geometry.handle.height - geometry.thumb.y <= THUMB_WIDTH)
         priv->allow_resize_paned = TRUE;
       break;
     case OS_SIDE_TOP:
-      if (y_pos - y <= THUMB_WIDTH)
+      if (geometry.thumb.y - geometry.handle.y <= THUMB_WIDTH)
         priv->allow_resize_paned = TRUE;
       break;
     default:
@@ -3233,94 +5276,141 @@ retrieve_resizability (GtkScrollbar *scrollbar)
 }
 
 static void
-hijacked_scrollbar_size_allocate (GtkWidget    *widget,
-                                  GdkRectangle *allocation)
+overlay_scrollbar_size_allocate (GtkWidget    *widget,
+                                 GdkRectangle *allocation)
 {
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
-      OsScrollbarPrivate *priv;
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
 
-      scrollbar = GTK_SCROLLBAR (widget);
-      priv = get_private (widget);
+  OsSide side;
 
-      /* Get the side, then move thumb and bar accordingly. */
-      retrieve_side (scrollbar);
+  scrollbar = GTK_SCROLLBAR (widget);
+  priv = get_private (widget);
 
-      priv->trough.x = allocation->x;
-      priv->trough.y = allocation->y;
-      priv->trough.width = allocation->width;
-      priv->trough.height = allocation->height;
+  side = priv->side;
 
-      priv->bar_all = *allocation;
-      priv->thumb_all = *allocation;
+  /* Get the side, then move thumb and bar accordingly. */
+  retrieve_side (scrollbar);
 
+  /* Same allocation and side, the layout didn't change.
+   * Just check the resizability, in case the toplevel changed. */
+  if (priv->allocation_valid &&
+      priv->side == side &&
+      priv->trough.x == allocation->x &&
+      priv->trough.y == allocation->y &&
+      priv->trough.width == allocation->width &&
+      priv->trough.height == allocation->height)
+    {
       if (priv->orientation == GTK_ORIENTATION_VERTICAL)
-        {
-          priv->slider.width = THUMB_WIDTH;
-          if (priv->slider.height != MIN (THUMB_HEIGHT, allocation->height))
-            {
-              priv->slider.height = MIN (THUMB_HEIGHT, allocation->height);
-              os_thumb_resize (OS_THUMB (priv->thumb), priv->slider.width, priv->slider.height);
-            }
+        allocation->width = 0;
+      else
+        allocation->height = 0;
 
-          if (priv->side == OS_SIDE_RIGHT)
-            priv->bar_all.x = allocation->x - BAR_SIZE;
+      retrieve_resizability (scrollbar);
 
-          priv->bar_all.width = BAR_SIZE;
+      gtk_widget_set_allocation (widget, allocation);
 
-          priv->thumb_all.width = THUMB_WIDTH;
+      return;
+    }
 
-          if (priv->side == OS_SIDE_RIGHT)
-            priv->thumb_all.x = allocation->x - priv->bar_all.width;
-          else
-            priv->thumb_all.x = allocation->x + priv->bar_all.width - priv->thumb_all.width;
+  priv->allocation_valid = TRUE;
 
-          allocation->width = 0;
-        }
-      else
-        {
-          priv->slider.height = THUMB_WIDTH;
-          if (priv->slider.width != MIN (THUMB_HEIGHT, allocation->width))
-            {
-              priv->slider.width = MIN (THUMB_HEIGHT, allocation->width);
-              os_thumb_resize (OS_THUMB (priv->thumb), priv->slider.width, priv->slider.height);
-            }
+  priv->trough.x = allocation->x;
+  priv->trough.y = allocation->y;
+  priv->trough.width = allocation->width;
+  priv->trough.height = allocation->height;
 
-          if (priv->side == OS_SIDE_BOTTOM)
-            priv->bar_all.y = allocation->y - BAR_SIZE;
+  priv->bar_all = *allocation;
+  priv->thumb_all = *allocation;
 
-          priv->bar_all.height = BAR_SIZE;
+  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+    {
+      priv->slider.width = THUMB_WIDTH;
+      if (priv->slider.height != MIN (THUMB_HEIGHT, allocation->height))
+        {
+          priv->slider.height = MIN (THUMB_HEIGHT, allocation->height);
+          if (priv->thumb != NULL)
+            os_thumb_resize (OS_THUMB (priv->thumb), priv->slider.width, priv->slider.height);
+        }
 
-          priv->thumb_all.height = THUMB_WIDTH;
+      if (priv->side == OS_SIDE_RIGHT)
+        priv->bar_all.x = allocation->x - BAR_SIZE;
 
-          if (priv->side == OS_SIDE_BOTTOM)
-            priv->thumb_all.y = allocation->y - priv->bar_all.height;
-          else
-            priv->thumb_all.y = allocation->y + priv->bar_all.height - priv->thumb_all.height;
+      priv->bar_all.width = BAR_SIZE;
 
-          allocation->height = 0;
-        }
+      priv->thumb_all.width = THUMB_WIDTH;
+
+      if (priv->side == OS_SIDE_RIGHT)
+        priv->thumb_all.x = allocation->x - priv->bar_all.width;
+      else
+        priv->thumb_all.x = allocation->x + priv->bar_all.width - priv->thumb_all.width;
 
-      if (priv->adjustment != NULL)
+      allocation->width = 0;
+    }
+  else
+    {
+      priv->slider.height = THUMB_WIDTH;
+      if (priv->slider.width != MIN (THUMB_HEIGHT, allocation->width))
         {
-          calc_layout_bar (scrollbar, gtk_adjustment_get_value (priv->adjustment));
-          calc_layout_slider (scrollbar, gtk_adjustment_get_value (priv->adjustment));
+          priv->slider.width = MIN (THUMB_HEIGHT, allocation->width);
+          if (priv->thumb != NULL)
+            os_thumb_resize (OS_THUMB (priv->thumb), priv->slider.width, priv->slider.height);
         }
 
-      os_bar_size_allocate (priv->bar, priv->bar_all);
+      if (priv->side == OS_SIDE_BOTTOM)
+        priv->bar_all.y = allocation->y - BAR_SIZE;
 
-      move_bar (scrollbar);
+      priv->bar_all.height = BAR_SIZE;
 
-      /* Set resizability. */
-      retrieve_resizability (scrollbar);
+      priv->thumb_all.height = THUMB_WIDTH;
 
-      gtk_widget_set_allocation (widget, allocation);
+      if (priv->side == OS_SIDE_BOTTOM)
+        priv->thumb_all.y = allocation->y - priv->bar_all.height;
+      else
+        priv->thumb_all.y = allocation->y + priv->bar_all.height - priv->thumb_all.height;
 
-      return;
+      allocation->height = 0;
+    }
+
+  if (priv->adjustment != NULL)
+    {
+      calc_layout (scrollbar, gtk_adjustment_get_value (priv->adjustment));
     }
 
-  (* pre_hijacked_scrollbar_size_allocate) (widget, allocation);
+  /* Nobody can see the bar, resize it when the toplevel is viewable. */
+  if (priv->suspended)
+    priv->update |= OS_UPDATE_LAYOUT;
+  else
+    os_bar_size_allocate (priv->bar, priv->bar_all);
+
+  update_window_filter (scrollbar);
+
+  move_bar (scrollbar);
+
+  /* Set resizability. */
+  retrieve_resizability (scrollbar);
+
+  gtk_widget_set_allocation (widget, allocation);
+}
+
+static void
+hijacked_scrollbar_size_allocate (GtkWidget    *widget,
+                                  GdkRectangle *allocation)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_size_allocate (widget, allocation);
+  else
+    (* pre_hijacked_scrollbar_size_allocate) (widget, allocation);
+}
+
+static void
+overlay_vtable_size_allocate (GtkWidget    *widget,
+                              GdkRectangle *allocation)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_size_allocate) (widget, allocation);
+  else
+    overlay_scrollbar_size_allocate (widget, allocation);
 }
 
 /* Set the scrollbar to be insensitive. */
@@ -3334,7 +5424,7 @@ set_insensitive (GtkScrollbar *scrollbar)
   priv->filter.proximity = FALSE;
   remove_window_filter (scrollbar);
 
-  gtk_widget_hide (priv->thumb);
+  hide_thumb_window (scrollbar);
 }
 
 /* Set the scrollbar to be sensitive. */
@@ -3356,117 +5446,186 @@ set_sensitive (GtkScrollbar *scrollbar)
 }
 
 static void
-hijacked_scrollbar_size_request (GtkWidget      *widget,
-                                 GtkRequisition *requisition)
+overlay_scrollbar_size_request (GtkWidget      *widget,
+                                GtkRequisition *requisition)
 {
-  if (use_overlay_scrollbar ())
-    {
-      OsScrollbarPrivate *priv;
+  OsScrollbarPrivate *priv;
 
-      priv = get_private (widget);
+  priv = get_private (widget);
 
-      if (priv->orientation == GTK_ORIENTATION_VERTICAL)
-        requisition->width = 0;
-      else
-        requisition->height = 0;
+  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+    requisition->width = 0;
+  else
+    requisition->height = 0;
 
-      widget->requisition = *requisition;
+  widget->requisition = *requisition;
+}
 
-      return;
-    }
+static void
+hijacked_scrollbar_size_request (GtkWidget      *widget,
+                                 GtkRequisition *requisition)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_size_request (widget, requisition);
+  else
+    (* pre_hijacked_scrollbar_size_request) (widget, requisition);
+}
 
-  (* pre_hijacked_scrollbar_size_request) (widget, requisition);
+static void
+overlay_vtable_size_request (GtkWidget      *widget,
+                             GtkRequisition *requisition)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_size_request) (widget, requisition);
+  else
+    overlay_scrollbar_size_request (widget, requisition);
 }
 
 static void
-hijacked_scrollbar_state_changed (GtkWidget    *widget,
-                                  GtkStateType  state)
+overlay_scrollbar_state_changed (GtkWidget    *widget,
+                                 GtkStateType  state)
 {
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
+  GtkScrollbar *scrollbar;
 
-      scrollbar = GTK_SCROLLBAR (widget);
+  scrollbar = GTK_SCROLLBAR (widget);
 
-      if (gtk_widget_get_state (widget) == GTK_STATE_INSENSITIVE)
-        set_insensitive (scrollbar);
-      else
-        set_sensitive (scrollbar);
+  if (gtk_widget_get_state (widget) == GTK_STATE_INSENSITIVE)
+    set_insensitive (scrollbar);
+  else
+    set_sensitive (scrollbar);
+}
 
-      return;
-    }
+static void
+hijacked_scrollbar_state_changed (GtkWidget    *widget,
+                                  GtkStateType  state)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_state_changed (widget, state);
+  else
+    (* pre_hijacked_scrollbar_state_changed) (widget, state);
+}
 
-  (* pre_hijacked_scrollbar_state_changed) (widget, state);
+static void
+overlay_vtable_state_changed (GtkWidget    *widget,
+                              GtkStateType  state)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_state_changed) (widget, state);
+  else
+    overlay_scrollbar_state_changed (widget, state);
 }
 
 static void
-hijacked_scrollbar_unmap (GtkWidget *widget)
+overlay_scrollbar_unmap (GtkWidget *widget)
 {
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
-      OsScrollbarPrivate *priv;
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
 
-      scrollbar = GTK_SCROLLBAR (widget);
-      priv = get_private (widget);
+  scrollbar = GTK_SCROLLBAR (widget);
+  priv = get_private (widget);
 
-      (* widget_class_unmap) (widget);
+  (* widget_class_unmap) (widget);
 
-      os_bar_hide (priv->bar);
+  os_bar_hide (priv->bar);
 
-      gtk_widget_hide (priv->thumb);
+  hide_thumb_window (scrollbar);
 
-      priv->filter.proximity = FALSE;
-      remove_window_filter (scrollbar);
+  priv->filter.proximity = FALSE;
+  remove_window_filter (scrollbar);
+}
 
-      return;
-    }
+static void
+hijacked_scrollbar_unmap (GtkWidget *widget)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_unmap (widget);
+  else
+    (* pre_hijacked_scrollbar_unmap) (widget);
+}
 
-  (* pre_hijacked_scrollbar_unmap) (widget);
+static void
+overlay_vtable_unmap (GtkWidget *widget)
+{
+  if (use_native_scrollbar (widget))
+    (* pre_hijacked_scrollbar_unmap) (widget);
+  else
+    overlay_scrollbar_unmap (widget);
 }
 
 static void
-hijacked_scrollbar_unrealize (GtkWidget *widget)
+overlay_scrollbar_unrealize (GtkWidget *widget)
 {
-  scrollbar_list = g_slist_remove (scrollbar_list, widget);
+  GtkScrollbar *scrollbar;
+  OsScrollbarPrivate *priv;
 
-  if (use_overlay_scrollbar ())
-    {
-      GtkScrollbar *scrollbar;
-      OsScrollbarPrivate *priv;
+  scrollbar = GTK_SCROLLBAR (widget);
+  priv = get_private (widget);
 
-      scrollbar = GTK_SCROLLBAR (widget);
-      priv = get_private (widget);
+  g_hash_table_remove (scrollbar_table, widget);
 
-      os_bar_hide (priv->bar);
+  os_bar_hide (priv->bar);
 
-      /* There could be a race where the window is unrealized while
-       * the pointer just reached the proximity area and started the timeout,
-       * protect against it. */
-      if (priv->source_show_thumb_id != 0)
-        {
-          g_source_remove (priv->source_show_thumb_id);
-          priv->source_show_thumb_id = 0;
-        }
+  /* There could be a race where the window is unrealized while
+   * the pointer just reached the proximity area and started the timeout,
+   * protect against it. */
+  os_timer_cancel (&priv->show_thumb_timer);
 
-      gtk_widget_hide (priv->thumb);
+  cancel_drag (scrollbar);
+  cancel_wheel (scrollbar);
 
-      priv->filter.running = FALSE;
-      gdk_window_remove_filter (gtk_widget_get_window (widget), window_filter_func, scrollbar);
+  hide_thumb_window (scrollbar);
 
-      g_signal_handlers_disconnect_by_func (G_OBJECT (gtk_widget_get_toplevel (widget)),
-                                            G_CALLBACK (toplevel_configure_event_cb), scrollbar);
+  unwatch_workarea (scrollbar);
 
-      os_bar_set_parent (priv->bar, NULL);
+  /* The toplevel is going away, drop the cached stacking and transient hint. */
+  if (priv->thumb != NULL)
+    gtk_window_set_transient_for (GTK_WINDOW (priv->thumb), NULL);
+  priv->restack_xid = None;
 
-      (* widget_class_unrealize) (widget);
+  remove_window_filter (scrollbar);
 
-      return;
-    }
+  leave_window_group (scrollbar);
+
+  registry_unlink (&priv->toplevel_link);
+
+  if (priv->suspended)
+    resume_scrollbar (scrollbar);
+
+  os_bar_set_parent (priv->bar, NULL);
+
+  (* widget_class_unrealize) (widget);
+}
+
+static void
+native_scrollbar_unrealize (GtkWidget *widget)
+{
+  g_hash_table_remove (scrollbar_table, widget);
 
   (* pre_hijacked_scrollbar_unrealize) (widget);
 }
 
+static void
+hijacked_scrollbar_unrealize (GtkWidget *widget)
+{
+  if (use_overlay_scrollbar (widget))
+    overlay_scrollbar_unrealize (widget);
+  else
+    native_scrollbar_unrealize (widget);
+
+  /* Unrealized with the previous mode, it's realized again with the new one. */
+  if (mode_switch.pending != NULL)
+    g_hash_table_remove (mode_switch.pending, widget);
+}
+
+static void
+overlay_vtable_unrealize (GtkWidget *widget)
+{
+  if (use_native_scrollbar (widget))
+    native_scrollbar_unrealize (widget);
+  else
+    overlay_scrollbar_unrealize (widget);
+}
+
 /* Check if the application is blacklisted. */
 static gboolean
 app_is_blacklisted (void)
@@ -3538,9 +5697,70 @@ app_is_blacklisted (void)
   return FALSE;
 }
 
-/* Patch GtkScrollbar vtable. */
+/* Fill the vtables, once the original vfuncs are stored. */
+static void
+init_scrollbar_vtables (void)
+{
+  original_vtable.dispose = pre_hijacked_scrollbar_dispose;
+  original_vtable.expose_event = pre_hijacked_scrollbar_expose_event;
+  original_vtable.grab_notify = pre_hijacked_scrollbar_grab_notify;
+  original_vtable.hide = pre_hijacked_scrollbar_hide;
+  original_vtable.map = pre_hijacked_scrollbar_map;
+  original_vtable.realize = pre_hijacked_scrollbar_realize;
+  original_vtable.show = pre_hijacked_scrollbar_show;
+  original_vtable.size_allocate = pre_hijacked_scrollbar_size_allocate;
+  original_vtable.size_request = pre_hijacked_scrollbar_size_request;
+  original_vtable.state_changed = pre_hijacked_scrollbar_state_changed;
+  original_vtable.unmap = pre_hijacked_scrollbar_unmap;
+  original_vtable.unrealize = pre_hijacked_scrollbar_unrealize;
+
+  /* The native scrollbars only need to be tracked on realize. */
+  native_vtable = original_vtable;
+  native_vtable.realize = native_scrollbar_realize;
+  native_vtable.unrealize = native_scrollbar_unrealize;
+
+  switch_vtable.dispose = hijacked_scrollbar_dispose;
+  switch_vtable.expose_event = hijacked_scrollbar_expose_event;
+  switch_vtable.grab_notify = hijacked_scrollbar_grab_notify;
+  switch_vtable.hide = hijacked_scrollbar_hide;
+  switch_vtable.map = hijacked_scrollbar_map;
+  switch_vtable.realize = hijacked_scrollbar_realize;
+  switch_vtable.show = hijacked_scrollbar_show;
+  switch_vtable.size_allocate = hijacked_scrollbar_size_allocate;
+  switch_vtable.size_request = hijacked_scrollbar_size_request;
+  switch_vtable.state_changed = hijacked_scrollbar_state_changed;
+  switch_vtable.unmap = hijacked_scrollbar_unmap;
+  switch_vtable.unrealize = hijacked_scrollbar_unrealize;
+
+  /* The overlay scrollbars fall back to the original vfuncs
+   * if the application opted out, see overlay_vtable_realize (). */
+  overlay_vtable.dispose = overlay_scrollbar_dispose;
+  overlay_vtable.expose_event = overlay_vtable_expose_event;
+  overlay_vtable.grab_notify = overlay_vtable_grab_notify;
+  overlay_vtable.hide = overlay_vtable_hide;
+  overlay_vtable.map = overlay_vtable_map;
+  overlay_vtable.realize = overlay_vtable_realize;
+  overlay_vtable.show = overlay_vtable_show;
+  overlay_vtable.size_allocate = overlay_vtable_size_allocate;
+  overlay_vtable.size_request = overlay_vtable_size_request;
+  overlay_vtable.state_changed = overlay_vtable_state_changed;
+  overlay_vtable.unmap = overlay_vtable_unmap;
+  overlay_vtable.unrealize = overlay_vtable_unrealize;
+
+  /* Without a grab_notify vfunc there's nothing to replace. */
+  if (pre_hijacked_scrollbar_grab_notify == NULL)
+    {
+      switch_vtable.grab_notify = NULL;
+      overlay_vtable.grab_notify = NULL;
+    }
+}
+
+/* Patch the GtkScrollbar vtable and the ones of its subclasses,
+ * replacing the vfuncs of the installed vtable with the new ones.
+ * Vfuncs overridden by subclasses are kept. */
 static void
-patch_scrollbar_class_vtable (GType type)
+patch_scrollbar_class_vtable (GType                    type,
+                              const OsScrollbarVtable *vtable)
 {
   GObjectClass *object_class;
   GtkWidgetClass *widget_class;
@@ -3551,40 +5771,62 @@ patch_scrollbar_class_vtable (GType type)
   object_class = g_type_class_ref (type);
   widget_class = g_type_class_ref (type);
 
-  if (object_class->dispose == pre_hijacked_scrollbar_dispose)
-    object_class->dispose = hijacked_scrollbar_dispose;
-
-  if (widget_class->expose_event == pre_hijacked_scrollbar_expose_event)
-    widget_class->expose_event = hijacked_scrollbar_expose_event;
-  if (widget_class->size_request == pre_hijacked_scrollbar_size_request)
-    widget_class->size_request = hijacked_scrollbar_size_request;
-  if (widget_class->state_changed == pre_hijacked_scrollbar_state_changed)
-    widget_class->state_changed = hijacked_scrollbar_state_changed;
-  if (pre_hijacked_scrollbar_grab_notify &&
-      widget_class->grab_notify == pre_hijacked_scrollbar_grab_notify)
-    widget_class->grab_notify = hijacked_scrollbar_grab_notify;
-  if (widget_class->hide == pre_hijacked_scrollbar_hide)
-    widget_class->hide = hijacked_scrollbar_hide;
-  if (widget_class->map == pre_hijacked_scrollbar_map)
-    widget_class->map = hijacked_scrollbar_map;
-  if (widget_class->realize == pre_hijacked_scrollbar_realize)
-    widget_class->realize = hijacked_scrollbar_realize;
-  if (widget_class->show == pre_hijacked_scrollbar_show)
-    widget_class->show = hijacked_scrollbar_show;
-  if (widget_class->size_allocate == pre_hijacked_scrollbar_size_allocate)
-    widget_class->size_allocate = hijacked_scrollbar_size_allocate;
-  if (widget_class->unmap == pre_hijacked_scrollbar_unmap)
-    widget_class->unmap = hijacked_scrollbar_unmap;
-  if (widget_class->unrealize == pre_hijacked_scrollbar_unrealize)
-    widget_class->unrealize = hijacked_scrollbar_unrealize;
+  if (object_class->dispose == scrollbar_vtable->dispose)
+    object_class->dispose = vtable->dispose;
+
+  if (widget_class->expose_event == scrollbar_vtable->expose_event)
+    widget_class->expose_event = vtable->expose_event;
+  if (widget_class->size_request == scrollbar_vtable->size_request)
+    widget_class->size_request = vtable->size_request;
+  if (widget_class->state_changed == scrollbar_vtable->state_changed)
+    widget_class->state_changed = vtable->state_changed;
+  if (widget_class->grab_notify == scrollbar_vtable->grab_notify)
+    widget_class->grab_notify = vtable->grab_notify;
+  if (widget_class->hide == scrollbar_vtable->hide)
+    widget_class->hide = vtable->hide;
+  if (widget_class->map == scrollbar_vtable->map)
+    widget_class->map = vtable->map;
+  if (widget_class->realize == scrollbar_vtable->realize)
+    widget_class->realize = vtable->realize;
+  if (widget_class->show == scrollbar_vtable->show)
+    widget_class->show = vtable->show;
+  if (widget_class->size_allocate == scrollbar_vtable->size_allocate)
+    widget_class->size_allocate = vtable->size_allocate;
+  if (widget_class->unmap == scrollbar_vtable->unmap)
+    widget_class->unmap = vtable->unmap;
+  if (widget_class->unrealize == scrollbar_vtable->unrealize)
+    widget_class->unrealize = vtable->unrealize;
 
   /* Recurse GType children. */
   children = g_type_children (type, &n);
   for (i = 0; i < n; i++)
-    patch_scrollbar_class_vtable (children[i]);
+    patch_scrollbar_class_vtable (children[i], vtable);
   g_free (children);
 }
 
+/* Install a vtable in GtkScrollbar and its subclasses. */
+static void
+install_scrollbar_vtable (const OsScrollbarVtable *vtable)
+{
+  if (vtable == scrollbar_vtable)
+    return;
+
+  patch_scrollbar_class_vtable (GTK_TYPE_SCROLLBAR, vtable);
+
+  scrollbar_vtable = vtable;
+}
+
+/* Get the vtable specialised for the current mode,
+ * the mode isn't checked again on each call. */
+static const OsScrollbarVtable*
+get_scrollbar_vtable (void)
+{
+  if (use_overlay_scrollbar (NULL))
+    return &overlay_vtable;
+
+  return &native_vtable;
+}
+
 /* Load custom style for overlay scrollbar. */
 static void
 custom_style_load (void)
@@ -3597,49 +5839,112 @@ custom_style_load (void)
                        "class \"GtkScrolledWindow\" style \"overlay-scrollbar\"");
 }
 
-/* Unload all scrollbars. */
+/* Switch a scrollbar to the current mode,
+ * unloading it with the previous mode and loading it again. */
 static void
-scrollbar_mode_changed_unload_gfunc (gpointer data,
-                                     gpointer user_data)
+switch_scrollbar_mode (GtkWidget *widget)
 {
-  GtkWidget *widget;
-  GSList **mapped_list;
+  gboolean mapped;
+
+  /* The following unrealize will unmap the widget,
+   * remember if it was mapped to remap it afterwards. */
+  mapped = gtk_widget_get_mapped (widget);
+
+  if (mapped)
+    gtk_widget_hide (widget);
 
-  widget = GTK_WIDGET (data);
-  mapped_list = user_data;
+  /* Removes the widget from the pending scrollbars. */
+  gtk_widget_unrealize (widget);
+
+  gtk_widget_realize (widget);
 
-  /* The following unrealize will unmap the widget:
-   * create a list of mapped scrollbars to remap them afterwards. */
-  if (gtk_widget_get_mapped (widget))
+  /* Request a resize to update widget allocation. */
+  if (mapped)
     {
-      *mapped_list = g_slist_prepend (*mapped_list, widget);
-      gtk_widget_hide (widget);
+      gtk_widget_show (widget);
+      gtk_widget_queue_resize (widget);
     }
 
-  gtk_widget_unrealize (widget);
+  mode_switch.n_scrollbars++;
 }
 
-/* Load all scrollbars. */
+/* Add a realized scrollbar to the pending scrollbars of the mode switch,
+ * sorting the ones inside a visible toplevel first. */
 static void
-scrollbar_mode_changed_load_gfunc (gpointer data,
-                                   gpointer user_data)
+queue_mode_switch_hfunc (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
 {
-  gtk_widget_realize (GTK_WIDGET (data));
+  GSList **hidden_list;
+  GtkWidget *widget;
+
+  widget = GTK_WIDGET (key);
+  hidden_list = user_data;
+
+  g_hash_table_insert (mode_switch.pending, widget, widget);
+
+  if (gtk_widget_get_mapped (gtk_widget_get_toplevel (widget)))
+    mode_switch.queue = g_slist_prepend (mode_switch.queue, widget);
+  else
+    *hidden_list = g_slist_prepend (*hidden_list, widget);
 }
 
-/* Complete load of all scrollbars. */
-static void
-scrollbar_mode_changed_load_end_gfunc (gpointer data,
-                                       gpointer user_data)
+/* Switch the pending scrollbars until the budget in us is spent,
+ * returns TRUE if the mode switch is complete. */
+static gboolean
+run_mode_switch (gint64 budget)
 {
-  GtkWidget *widget;
+  gint64 start_time, elapsed;
+
+  start_time = g_get_monotonic_time ();
+
+  while (mode_switch.queue != NULL &&
+         g_get_monotonic_time () - start_time < budget)
+    {
+      GtkWidget *widget;
+
+      widget = mode_switch.queue->data;
+      mode_switch.queue = g_slist_delete_link (mode_switch.queue, mode_switch.queue);
+
+      /* Skip the scrollbars unrealized meanwhile, they already left. */
+      if (g_hash_table_lookup (mode_switch.pending, widget) != NULL)
+        switch_scrollbar_mode (widget);
+    }
+
+  elapsed = g_get_monotonic_time () - start_time;
+
+  mode_switch.worst_slice = MAX (mode_switch.worst_slice, elapsed);
+  mode_switch.n_slices++;
+
+  if (mode_switch.queue != NULL)
+    return FALSE;
+
+  OS_LOG (OS_INFO, "mode switch of %u scrollbars in %u slices: "
+          "%" G_GINT64_FORMAT " us total, %" G_GINT64_FORMAT " us worst slice",
+          mode_switch.n_scrollbars, mode_switch.n_slices,
+          g_get_monotonic_time () - mode_switch.start_time,
+          mode_switch.worst_slice);
+
+  g_hash_table_destroy (mode_switch.pending);
+  mode_switch.pending = NULL;
+
+  /* Every scrollbar is in the new mode, drop the per-call checks. */
+  install_scrollbar_vtable (get_scrollbar_vtable ());
+
+  return TRUE;
+}
 
-  widget = GTK_WIDGET (data);
+/* Callback switching a slice of the pending scrollbars. */
+static gboolean
+mode_switch_cb (gpointer user_data)
+{
+  if (run_mode_switch (MODE_SWITCH_SLICE_BUDGET))
+    {
+      mode_switch.source_id = 0;
+      return FALSE;
+    }
 
-  /* Remap the list of scrollbars that were unmapped by the unload gfunc.
-   * Request a resize to update widget allocation. */
-  gtk_widget_show (widget);
-  gtk_widget_queue_resize (widget);
+  return TRUE;
 }
 
 /* Callback called when scrollbar-mode changes. */
@@ -3649,37 +5954,62 @@ scrollbar_mode_changed_cb (GObject    *object,
                            gpointer    user_data)
 {
   GSettings *settings;
-  GSList *tmp_list, *mapped_list;
+  GSList *hidden_list;
 
   settings = G_SETTINGS (object);
-  tmp_list = g_slist_copy (scrollbar_list);
+
+  /* Complete the previous mode switch first,
+   * every scrollbar has to leave the same previous mode. */
+  if (mode_switch.pending != NULL)
+    {
+      g_source_remove (mode_switch.source_id);
+      mode_switch.source_id = 0;
+
+      run_mode_switch (G_MAXINT64);
+    }
+
+  /* Scrollbars in both modes coexist until the switch is complete. */
+  install_scrollbar_vtable (&switch_vtable);
+
+  mode_switch.pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+  mode_switch.previous_mode = scrollbar_mode;
+  mode_switch.start_time = g_get_monotonic_time ();
+  mode_switch.worst_slice = 0;
+  mode_switch.n_scrollbars = 0;
+  mode_switch.n_slices = 0;
 
   /* Initialize the pointer by initializing its variable. */
-  mapped_list = NULL;
+  hidden_list = NULL;
 
-  /* Unload all scrollbars, using previous scrollbar_mode. */
-  g_slist_foreach (tmp_list, scrollbar_mode_changed_unload_gfunc, &mapped_list);
+  g_hash_table_foreach (scrollbar_table, queue_mode_switch_hfunc, &hidden_list);
+  mode_switch.queue = g_slist_concat (mode_switch.queue, hidden_list);
 
-  /* Update the scrollbar_mode variable. */
+  /* Update the scrollbar_mode variable,
+   * the pending scrollbars keep the previous one until switched. */
   scrollbar_mode = g_settings_get_enum (settings, "scrollbar-mode");
 
   /* Gtk+ 2.0 doesn't support dynamic loading of styles.
    * Please contact me in case I'm wrong,
    * and I'll add the required bits here. */
 
-  /* Load all scrollbars, using new scrollbar_mode. */
-  g_slist_foreach (tmp_list, scrollbar_mode_changed_load_gfunc, NULL);
-
-  /* Map the scrollbars that were unmapped by unload. */
-  g_slist_foreach (mapped_list, scrollbar_mode_changed_load_end_gfunc, NULL);
-
-  g_slist_free (mapped_list);
-  g_slist_free (tmp_list);
+  /* Switch the scrollbars in slices, letting the redraws run between them. */
+  mode_switch.source_id = g_idle_add (mode_switch_cb, NULL);
 }
 
 /* Suppress the warning 'missing-declarations'. */
+const gchar* g_module_check_init (GModule *module);
 void gtk_module_init (void);
 
+/* Keep the handle of the module, to make it resident
+ * once the workarea watcher thread is started. */
+const gchar*
+g_module_check_init (GModule *module)
+{
+  os_module = module;
+
+  return NULL;
+}
+
 void
 gtk_module_init (void)
 {
@@ -3691,11 +6021,28 @@ gtk_module_init (void)
   if (app_is_blacklisted ())
     return;
 
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+  /* The thumb images are rendered in a worker thread. */
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+#endif
+
   /* Initialize static variables. */
   net_active_window_atom = gdk_x11_get_xatom_by_name ("_NET_ACTIVE_WINDOW");
+  net_restack_window_atom = gdk_x11_get_xatom_by_name ("_NET_RESTACK_WINDOW");
   unity_net_workarea_region_atom = gdk_x11_get_xatom_by_name ("_UNITY_NET_WORKAREA_REGION");
+  os_quark_dispatcher = g_quark_from_static_string ("os_quark_dispatcher");
   os_quark_placement = g_quark_from_static_string ("os_quark_placement");
   os_quark_qdata = g_quark_from_static_string ("os-scrollbar");
+  os_quark_toplevel = g_quark_from_static_string ("os_quark_toplevel");
+  os_root_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+  scrollbar_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+  restack_table = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, free_restack_request);
+  restack_serials = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  /* Chain the error handler installed by Gdk. */
+  pre_x_error_handler = XSetErrorHandler (x_error_handler);
 
   /* Store GtkScrollbar vfunc pointers. */
   object_class = g_type_class_ref (GTK_TYPE_SCROLLBAR);
@@ -3725,9 +6072,6 @@ gtk_module_init (void)
   widget_class_unmap     = widget_class->unmap;
   widget_class_unrealize = widget_class->unrealize;
 
-  /* Patch GtkScrollbar vtable. */
-  patch_scrollbar_class_vtable (GTK_TYPE_SCROLLBAR);
-
   /* Connect to gsettings. */
   settings = g_settings_new ("com.canonical.desktop.interface");
   g_signal_connect (settings, "changed::scrollbar-mode",
@@ -3736,7 +6080,11 @@ gtk_module_init (void)
 
   ubuntu_gtk_set_use_overlay_scrollbar (TRUE);
 
+  /* Patch GtkScrollbar vtable. */
+  init_scrollbar_vtables ();
+  install_scrollbar_vtable (get_scrollbar_vtable ());
+
   /* Load custom overlay scrollbar style. */
-  if (use_overlay_scrollbar ())
+  if (use_overlay_scrollbar (NULL))
     custom_style_load ();
 }
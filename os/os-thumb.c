@@ -34,12 +34,21 @@
 /* Timeout before the fade-out. */
 #define TIMEOUT_FADE_OUT 250
 
+/* Number of opacity levels used by the fade-out. */
+#define OPACITY_STEPS 16
+
 /* Thumb radius in pixels (higher values are automatically clamped). */
 #define THUMB_RADIUS 3
 
 /* Number of tolerance pixels, before hiding the thumb. */
 #define TOLERANCE_FADE 3
 
+/* Root coordinate used to park the hidden thumb, outside every monitor. */
+#define PARKED_POSITION (-4 * THUMB_HEIGHT)
+
+/* Number of pre-rendered images, two detached states for each action. */
+#define N_RENDERS 8
+
 typedef struct {
   gdouble red;
   gdouble green;
@@ -47,25 +56,57 @@ typedef struct {
   gdouble alpha;
 } GdkRGBA;
 
+/* Everything the drawing of the thumb depends on. */
+typedef struct {
+  GdkRGBA bg;
+  GdkRGBA bg_active;
+  GdkRGBA bg_selected;
+  GdkRGBA arrow_color;
+  GtkOrientation orientation;
+  GtkStateType state;
+  gint width;
+  gint height;
+  gint radius;
+} OsThumbLook;
+
+/* Pre-rendered images of the thumb, for each action and detached state. */
+typedef struct {
+  OsThumb *thumb;
+  OsThumbLook look;
+  cairo_surface_t *surfaces[N_RENDERS];
+  guint generation;
+} OsThumbRender;
+
 struct _OsThumbPrivate {
   GtkOrientation orientation;
   GtkWidget *grabbed_widget;
   OsAnimation *animation;
   OsCoordinate pointer;
   OsCoordinate pointer_root;
+  OsCoordinate position;
   OsEventFlags event;
+  OsThumbLook render_look;
+  OsThumbRender *render;
   gboolean rgba;
   gboolean detached;
+  gboolean parked;
+  gboolean render_pending;
   gboolean tolerance;
-  guint32 source_id;
+  gint opacity_level;
+  guint opacity_changes;
+  guint render_generation;
+  OsTimer fade_out_timer;
 };
 
+static GThreadPool *render_pool = NULL;
+
 enum {
   PROP_0,
   PROP_ORIENTATION,
   LAST_ARG
 };
 
+static void queue_render (OsThumb *thumb);
 static gboolean os_thumb_button_press_event (GtkWidget *widget, GdkEventButton *event);
 static gboolean os_thumb_button_release_event (GtkWidget *widget, GdkEventButton *event);
 static void os_thumb_composited_changed (GtkWidget *widget);
@@ -75,13 +116,38 @@ static gboolean os_thumb_motion_notify_event (GtkWidget *widget, GdkEventMotion
 static void os_thumb_map (GtkWidget *widget);
 static void os_thumb_screen_changed (GtkWidget *widget, GdkScreen *old_screen);
 static gboolean os_thumb_scroll_event (GtkWidget *widget, GdkEventScroll *event);
+static void os_thumb_size_allocate (GtkWidget *widget, GtkAllocation *allocation);
+static void os_thumb_style_set (GtkWidget *widget, GtkStyle *previous_style);
 static void os_thumb_unmap (GtkWidget *widget);
+static void os_thumb_unrealize (GtkWidget *widget);
 static GObject* os_thumb_constructor (GType type, guint n_construct_properties, GObjectConstructParam *construct_properties);
 static void os_thumb_dispose (GObject *object);
 static void os_thumb_finalize (GObject *object);
 static void os_thumb_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
 static void os_thumb_set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
 
+/* Set the opacity, quantised to OPACITY_STEPS levels,
+ * changing the window property only when the level changes. */
+static void
+set_opacity (OsThumb *thumb,
+             gdouble  opacity)
+{
+  OsThumbPrivate *priv;
+  gint level;
+
+  priv = thumb->priv;
+
+  level = (gint) floor (opacity * OPACITY_STEPS + 0.5);
+
+  if (level == priv->opacity_level)
+    return;
+
+  priv->opacity_level = level;
+  priv->opacity_changes++;
+
+  gtk_window_set_opacity (GTK_WINDOW (thumb), (gdouble) level / OPACITY_STEPS);
+}
+
 /* Callback called by the fade-out animation. */
 static void
 fade_out_cb (gfloat   weight,
@@ -92,9 +158,13 @@ fade_out_cb (gfloat   weight,
   thumb = OS_THUMB (user_data);
 
   if (weight < 1.0f)
-    gtk_window_set_opacity (GTK_WINDOW (thumb), fabs (weight - 1.0f));
+    set_opacity (thumb, fabs (weight - 1.0f));
   else
-    gtk_widget_hide (GTK_WIDGET (thumb));
+    {
+      OS_LOG (OS_INFO, "fade-out generated %u opacity changes", thumb->priv->opacity_changes);
+
+      gtk_widget_hide (GTK_WIDGET (thumb));
+    }
 }
 
 /* Stop function called by the fade-out animation. */
@@ -105,11 +175,13 @@ fade_out_stop_cb (gpointer user_data)
 
   thumb = OS_THUMB (user_data);
 
-  gtk_window_set_opacity (GTK_WINDOW (thumb), 1.0f);
+  set_opacity (thumb, 1.0f);
+
+  OS_LOG (OS_INFO, "stopped fade-out generated %u opacity changes", thumb->priv->opacity_changes);
 }
 
 /* Timeout before starting the fade-out animation. */
-static gboolean
+static void
 timeout_fade_out_cb (gpointer user_data)
 {
   OsThumb *thumb;
@@ -119,10 +191,18 @@ timeout_fade_out_cb (gpointer user_data)
 
   priv = thumb->priv;
 
-  os_animation_start (priv->animation);
-  priv->source_id = 0;
+  /* Without a compositor the opacity has no effect,
+   * hide the thumb straight away. */
+  if (!gdk_screen_is_composited (gtk_widget_get_screen (GTK_WIDGET (thumb))))
+    {
+      gtk_widget_hide (GTK_WIDGET (thumb));
 
-  return FALSE;
+      return;
+    }
+
+  priv->opacity_changes = 0;
+
+  os_animation_start (priv->animation);
 }
 
 G_DEFINE_TYPE (OsThumb, os_thumb, GTK_TYPE_WINDOW);
@@ -145,7 +225,10 @@ os_thumb_class_init (OsThumbClass *class)
   widget_class->motion_notify_event  = os_thumb_motion_notify_event;
   widget_class->screen_changed       = os_thumb_screen_changed;
   widget_class->scroll_event         = os_thumb_scroll_event;
+  widget_class->size_allocate        = os_thumb_size_allocate;
+  widget_class->style_set            = os_thumb_style_set;
   widget_class->unmap                = os_thumb_unmap;
+  widget_class->unrealize            = os_thumb_unrealize;
 
   gobject_class->constructor  = os_thumb_constructor;
   gobject_class->dispose      = os_thumb_dispose;
@@ -177,6 +260,10 @@ os_thumb_init (OsThumb *thumb)
   priv->animation = os_animation_new (RATE_ANIMATION, DURATION_FADE_OUT,
                                       fade_out_cb, NULL, thumb);
 
+  os_timer_init (&priv->fade_out_timer, timeout_fade_out_cb, thumb);
+
+  priv->opacity_level = OPACITY_STEPS;
+
   gtk_window_set_skip_pager_hint (GTK_WINDOW (thumb), TRUE);
   gtk_window_set_skip_taskbar_hint (GTK_WINDOW (thumb), TRUE);
   gtk_window_set_decorated (GTK_WINDOW (thumb), FALSE);
@@ -203,11 +290,7 @@ os_thumb_button_press_event (GtkWidget      *widget,
   thumb = OS_THUMB (widget);
   priv = thumb->priv;
 
-  if (priv->source_id != 0)
-    {
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
-    }
+  os_timer_cancel (&priv->fade_out_timer);
 
   /* Stop the animation on user interaction,
    * the button_press_event. */
@@ -296,6 +379,8 @@ os_thumb_composited_changed (GtkWidget *widget)
         priv->rgba = TRUE;
     }
 
+  queue_render (thumb);
+
   gtk_widget_queue_draw (widget);
 }
 
@@ -608,45 +693,34 @@ enum {
   ACTION_NORMAL,
   ACTION_DRAG,
   ACTION_PAGE_UP,
-  ACTION_PAGE_DOWN
+  ACTION_PAGE_DOWN,
+  N_ACTIONS
 };
 
-static gboolean
-os_thumb_expose (GtkWidget      *widget,
-                 GdkEventExpose *event)
+/* Draw the thumb, without touching any widget,
+ * so it's safe to call it from the render thread. */
+static void
+draw_thumb (cairo_t           *cr,
+            const OsThumbLook *look,
+            gint               action,
+            gboolean           detached)
 {
-  GtkAllocation allocation;
-  cairo_t *cr;
-  GtkStyle *style;
   GdkRGBA bg, bg_active, bg_selected;
   GdkRGBA bg_arrow_up, bg_arrow_down;
   GdkRGBA bg_shadow, bg_dark_line, bg_bright_line;
   GdkRGBA arrow_color;
-  OsThumb *thumb;
-  OsThumbPrivate *priv;
   cairo_pattern_t *pat;
   gint width, height;
   gint radius;
-  gint action;
-
-  thumb = OS_THUMB (widget);
-  priv = thumb->priv;
-
-  radius = priv->rgba ? THUMB_RADIUS : 0;
 
-  gtk_widget_get_allocation (widget, &allocation);
- 
-  width = allocation.width;
-  height = allocation.height;
-
-  style = gtk_widget_get_style (widget);
+  bg = look->bg;
+  bg_active = look->bg_active;
+  bg_selected = look->bg_selected;
+  arrow_color = look->arrow_color;
 
-  convert_gdk_color_to_gdk_rgba (&style->bg[gtk_widget_get_state (widget)], &bg);
-  convert_gdk_color_to_gdk_rgba (&style->bg[GTK_STATE_ACTIVE], &bg_active);
-  convert_gdk_color_to_gdk_rgba (&style->bg[GTK_STATE_SELECTED], &bg_selected);
-  convert_gdk_color_to_gdk_rgba (&style->fg[gtk_widget_get_state (widget)], &arrow_color);
-
-  cr = gdk_cairo_create (gtk_widget_get_window (widget));
+  width = look->width;
+  height = look->height;
+  radius = look->radius;
 
   cairo_save (cr);
 
@@ -661,19 +735,6 @@ os_thumb_expose (GtkWidget      *widget,
   cairo_set_line_width (cr, 1.0);
   cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
 
-  /* Type of action. */
-  action = ACTION_NORMAL;
-  if (priv->event & OS_EVENT_BUTTON_PRESS)
-    {
-      if (priv->event & OS_EVENT_MOTION_NOTIFY)
-        action = ACTION_DRAG;
-      else if ((priv->orientation == GTK_ORIENTATION_VERTICAL && (priv->pointer.y < height / 2)) ||
-               (priv->orientation == GTK_ORIENTATION_HORIZONTAL && (priv->pointer.x < width / 2)))
-        action = ACTION_PAGE_UP;
-      else
-        action = ACTION_PAGE_DOWN;
-    }
-
   /* Background. */
   draw_round_rect (cr, 0, 0, width, height, radius);
 
@@ -684,7 +745,7 @@ os_thumb_expose (GtkWidget      *widget,
   shade_gdk_rgba (&bg, 0.86, &bg_arrow_up);
   shade_gdk_rgba (&bg, 1.1, &bg_arrow_down);
 
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+  if (look->orientation == GTK_ORIENTATION_VERTICAL)
     pat = cairo_pattern_create_linear (0, 0, 0, height);
   else
     pat = cairo_pattern_create_linear (0, 0, width, 0);
@@ -708,7 +769,7 @@ os_thumb_expose (GtkWidget      *widget,
   if (action == ACTION_PAGE_UP ||
       action == ACTION_PAGE_DOWN)
     {
-      if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+      if (look->orientation == GTK_ORIENTATION_VERTICAL)
         {
           if (action == ACTION_PAGE_UP)
             cairo_rectangle (cr, 0, 0, width, height / 2);
@@ -732,7 +793,7 @@ os_thumb_expose (GtkWidget      *widget,
 
   cairo_set_line_width (cr, 2.0);
   draw_round_rect (cr, 0.5, 0.5, width - 1, height - 1, radius - 1);
-  if (!priv->detached)
+  if (!detached)
     set_source_gdk_rgba (cr, &bg_selected, 1.0);
   else
     set_source_gdk_rgba (cr, &bg_active, 1.0);
@@ -743,7 +804,7 @@ os_thumb_expose (GtkWidget      *widget,
   /* 1px subtle shadow around the background. */
   shade_gdk_rgba (&bg, 0.2, &bg_shadow);
 
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+  if (look->orientation == GTK_ORIENTATION_VERTICAL)
     pat = cairo_pattern_create_linear (0, 0, 0, height);
   else
     pat = cairo_pattern_create_linear (0, 0, width, 0);
@@ -784,10 +845,10 @@ os_thumb_expose (GtkWidget      *widget,
   cairo_stroke (cr);
 
   /* Only draw the grip when the thumb is at full height. */
-  if ((priv->orientation == GTK_ORIENTATION_VERTICAL && height == THUMB_HEIGHT - 1) ||
-      (priv->orientation == GTK_ORIENTATION_HORIZONTAL && width == THUMB_HEIGHT - 1) )
+  if ((look->orientation == GTK_ORIENTATION_VERTICAL && height == THUMB_HEIGHT - 1) ||
+      (look->orientation == GTK_ORIENTATION_HORIZONTAL && width == THUMB_HEIGHT - 1) )
     {
-      if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+      if (look->orientation == GTK_ORIENTATION_VERTICAL)
         pat = cairo_pattern_create_linear (0, 0, 0, height);
       else
         pat = cairo_pattern_create_linear (0, 0, width, 0);
@@ -800,7 +861,7 @@ os_thumb_expose (GtkWidget      *widget,
       cairo_pattern_destroy (pat);
 
       /* Grip. */
-      if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+      if (look->orientation == GTK_ORIENTATION_VERTICAL)
         {
           /* Page UP. */
           draw_grip (cr, width / 2 - 6.5, 13.5, 5, 6);
@@ -821,7 +882,7 @@ os_thumb_expose (GtkWidget      *widget,
     }
 
   /* Separators between the two steppers. */
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+  if (look->orientation == GTK_ORIENTATION_VERTICAL)
     {
       cairo_move_to (cr, 1.5, height / 2);
       cairo_line_to (cr, width - 1.5, height / 2);
@@ -847,7 +908,7 @@ os_thumb_expose (GtkWidget      *widget,
     }
 
   /* Arrows. */
-  if (priv->orientation == GTK_ORIENTATION_VERTICAL)
+  if (look->orientation == GTK_ORIENTATION_VERTICAL)
     {
       /* Direction UP. */
       cairo_save (cr);
@@ -882,6 +943,245 @@ os_thumb_expose (GtkWidget      *widget,
 
   cairo_restore (cr);
   cairo_restore (cr);
+}
+
+/* Get the look of the thumb from its current style and size. */
+static void
+get_look (OsThumb     *thumb,
+          OsThumbLook *look)
+{
+  GtkAllocation allocation;
+  GtkStyle *style;
+  GtkWidget *widget;
+  OsThumbPrivate *priv;
+
+  widget = GTK_WIDGET (thumb);
+  priv = thumb->priv;
+
+  gtk_widget_get_allocation (widget, &allocation);
+
+  style = gtk_widget_get_style (widget);
+
+  look->state = gtk_widget_get_state (widget);
+  look->orientation = priv->orientation;
+  look->width = allocation.width;
+  look->height = allocation.height;
+  look->radius = priv->rgba ? THUMB_RADIUS : 0;
+
+  convert_gdk_color_to_gdk_rgba (&style->bg[look->state], &look->bg);
+  convert_gdk_color_to_gdk_rgba (&style->bg[GTK_STATE_ACTIVE], &look->bg_active);
+  convert_gdk_color_to_gdk_rgba (&style->bg[GTK_STATE_SELECTED], &look->bg_selected);
+  convert_gdk_color_to_gdk_rgba (&style->fg[look->state], &look->arrow_color);
+}
+
+/* Compare two GdkRGBA colors. */
+static gboolean
+rgba_equal (const GdkRGBA *a,
+            const GdkRGBA *b)
+{
+  return a->red == b->red &&
+         a->green == b->green &&
+         a->blue == b->blue &&
+         a->alpha == b->alpha;
+}
+
+/* Compare two looks of the thumb. */
+static gboolean
+look_equal (const OsThumbLook *a,
+            const OsThumbLook *b)
+{
+  return a->state == b->state &&
+         a->orientation == b->orientation &&
+         a->width == b->width &&
+         a->height == b->height &&
+         a->radius == b->radius &&
+         rgba_equal (&a->bg, &b->bg) &&
+         rgba_equal (&a->bg_active, &b->bg_active) &&
+         rgba_equal (&a->bg_selected, &b->bg_selected) &&
+         rgba_equal (&a->arrow_color, &b->arrow_color);
+}
+
+/* Free a set of pre-rendered images. */
+static void
+render_free (OsThumbRender *render)
+{
+  gint i;
+
+  for (i = 0; i < N_RENDERS; i++)
+    {
+      if (render->surfaces[i] != NULL)
+        cairo_surface_destroy (render->surfaces[i]);
+    }
+
+  if (render->thumb != NULL)
+    g_object_unref (render->thumb);
+
+  g_slice_free (OsThumbRender, render);
+}
+
+/* Rasterise every state of the thumb, safe to call from any thread. */
+static void
+render_images (OsThumbRender *render)
+{
+  cairo_t *cr;
+  gint action;
+  gint detached;
+
+  for (action = 0; action < N_ACTIONS; action++)
+    {
+      for (detached = 0; detached < 2; detached++)
+        {
+          cairo_surface_t *surface;
+
+          surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                                render->look.width,
+                                                render->look.height);
+
+          cr = cairo_create (surface);
+          draw_thumb (cr, &render->look, action, detached);
+          cairo_destroy (cr);
+
+          render->surfaces[action * 2 + detached] = surface;
+        }
+    }
+}
+
+/* Publish a finished set of images, in the main loop. */
+static gboolean
+render_done_cb (gpointer user_data)
+{
+  OsThumb *thumb;
+  OsThumbPrivate *priv;
+  OsThumbRender *render;
+
+  render = user_data;
+  thumb = render->thumb;
+  priv = thumb->priv;
+
+  /* Drop the images of a look that has been replaced meanwhile. */
+  if (render->generation != priv->render_generation)
+    {
+      render_free (render);
+      return FALSE;
+    }
+
+  priv->render_pending = FALSE;
+
+  if (priv->render != NULL)
+    render_free (priv->render);
+
+  /* The images don't need the thumb anymore. */
+  render->thumb = NULL;
+  g_object_unref (thumb);
+
+  priv->render = render;
+
+  gtk_widget_queue_draw (GTK_WIDGET (thumb));
+
+  return FALSE;
+}
+
+/* Render the images in the worker thread. */
+static void
+render_thread_func (gpointer data,
+                    gpointer user_data)
+{
+  render_images (data);
+
+  g_idle_add (render_done_cb, data);
+}
+
+/* Pre-render the images of the current look of the thumb,
+ * in the worker thread. */
+static void
+queue_render (OsThumb *thumb)
+{
+  OsThumbLook look;
+  OsThumbPrivate *priv;
+  OsThumbRender *render;
+
+  priv = thumb->priv;
+
+  get_look (thumb, &look);
+
+  /* Not allocated yet. */
+  if (look.width <= 1 || look.height <= 1)
+    return;
+
+  /* Already rendered or being rendered. */
+  if ((priv->render_pending && look_equal (&look, &priv->render_look)) ||
+      (!priv->render_pending && priv->render != NULL && look_equal (&look, &priv->render->look)))
+    return;
+
+  render = g_slice_new0 (OsThumbRender);
+  render->thumb = g_object_ref (thumb);
+  render->look = look;
+  render->generation = ++priv->render_generation;
+
+  priv->render_look = look;
+  priv->render_pending = TRUE;
+
+  /* Threads are initialized by gtk_module_init (). */
+  if (render_pool == NULL)
+    render_pool = g_thread_pool_new (render_thread_func, NULL, 1, FALSE, NULL);
+
+  g_thread_pool_push (render_pool, render, NULL);
+}
+
+static gboolean
+os_thumb_expose (GtkWidget      *widget,
+                 GdkEventExpose *event)
+{
+  cairo_t *cr;
+  OsThumb *thumb;
+  OsThumbLook look;
+  OsThumbPrivate *priv;
+  gint action;
+
+  thumb = OS_THUMB (widget);
+  priv = thumb->priv;
+
+  get_look (thumb, &look);
+
+  /* Type of action. */
+  action = ACTION_NORMAL;
+  if (priv->event & OS_EVENT_BUTTON_PRESS)
+    {
+      if (priv->event & OS_EVENT_MOTION_NOTIFY)
+        action = ACTION_DRAG;
+      else if ((priv->orientation == GTK_ORIENTATION_VERTICAL && (priv->pointer.y < look.height / 2)) ||
+               (priv->orientation == GTK_ORIENTATION_HORIZONTAL && (priv->pointer.x < look.width / 2)))
+        action = ACTION_PAGE_UP;
+      else
+        action = ACTION_PAGE_DOWN;
+    }
+
+  cr = gdk_cairo_create (gtk_widget_get_window (widget));
+
+  if (priv->render != NULL && look_equal (&look, &priv->render->look))
+    {
+      cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+      cairo_set_source_surface (cr, priv->render->surfaces[action * 2 + (priv->detached ? 1 : 0)], 0, 0);
+      cairo_paint (cr);
+    }
+  else
+    {
+      /* The images for this look are not ready,
+       * stretch the previous ones, if any, until the worker publishes them.
+       * The thumb is never rasterised in the main loop. */
+      if (priv->render != NULL)
+        {
+          cairo_scale (cr,
+                       (gdouble) look.width / priv->render->look.width,
+                       (gdouble) look.height / priv->render->look.height);
+          cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+          cairo_set_source_surface (cr, priv->render->surfaces[action * 2 + (priv->detached ? 1 : 0)], 0, 0);
+          cairo_paint (cr);
+        }
+
+      queue_render (thumb);
+    }
+
   cairo_destroy (cr);
 
   return FALSE;
@@ -906,11 +1206,7 @@ os_thumb_leave_notify_event (GtkWidget        *widget,
    * Stop it only if OS_EVENT_BUTTON_PRESS is not set. */
   if (!(priv->event & OS_EVENT_BUTTON_PRESS))
     {
-      if (priv->source_id != 0)
-        {
-          g_source_remove (priv->source_id);
-          priv->source_id = 0;
-        }
+      os_timer_cancel (&priv->fade_out_timer);
 
       os_animation_stop (priv->animation, NULL);
     }
@@ -929,7 +1225,7 @@ os_thumb_map (GtkWidget *widget)
   thumb = OS_THUMB (widget);
   priv = thumb->priv;
 
-  gtk_window_set_opacity (GTK_WINDOW (widget), 1.0f);
+  set_opacity (thumb, 1.0f);
 
   if (priv->grabbed_widget != NULL)
     g_object_unref (priv->grabbed_widget);
@@ -943,6 +1239,24 @@ os_thumb_map (GtkWidget *widget)
       gtk_grab_remove (priv->grabbed_widget);
     }
 
+  /* The thumb is warm: the window is still mapped off-screen,
+   * so bring it back instead of mapping it again.
+   * It keeps its stacking position, the owner restacks it if needed. */
+  if (priv->parked)
+    {
+      GdkWindow *window;
+
+      window = gtk_widget_get_window (widget);
+
+      priv->parked = FALSE;
+
+      gtk_widget_set_mapped (widget, TRUE);
+
+      gdk_window_move (window, priv->position.x, priv->position.y);
+
+      return;
+    }
+
   GTK_WIDGET_CLASS (os_thumb_parent_class)->map (widget);
 }
 
@@ -956,11 +1270,7 @@ os_thumb_motion_notify_event (GtkWidget      *widget,
   thumb = OS_THUMB (widget);
   priv = thumb->priv;
 
-  if (priv->source_id != 0)
-    {
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
-    }
+  os_timer_cancel (&priv->fade_out_timer);
 
   /* On motion, stop the fade-out. */
   os_animation_stop (priv->animation, fade_out_stop_cb);
@@ -976,9 +1286,7 @@ os_thumb_motion_notify_event (GtkWidget      *widget,
          abs (priv->pointer.y - event->y) > TOLERANCE_FADE))
       {
         priv->tolerance = FALSE;
-        priv->source_id = g_timeout_add (TIMEOUT_FADE_OUT,
-                                         timeout_fade_out_cb,
-                                         thumb);
+        os_timer_schedule (&priv->fade_out_timer, TIMEOUT_FADE_OUT);
       }
   }
 
@@ -1022,11 +1330,7 @@ os_thumb_scroll_event (GtkWidget      *widget,
   thumb = OS_THUMB (widget);
   priv = thumb->priv;
 
-  if (priv->source_id != 0)
-    {
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
-    }
+  os_timer_cancel (&priv->fade_out_timer);
 
   /* If started, stop the fade-out. */
   os_animation_stop (priv->animation, fade_out_stop_cb);
@@ -1041,6 +1345,26 @@ os_thumb_scroll_event (GtkWidget      *widget,
   return FALSE;
 }
 
+static void
+os_thumb_size_allocate (GtkWidget     *widget,
+                        GtkAllocation *allocation)
+{
+  GTK_WIDGET_CLASS (os_thumb_parent_class)->size_allocate (widget, allocation);
+
+  queue_render (OS_THUMB (widget));
+}
+
+static void
+os_thumb_style_set (GtkWidget *widget,
+                    GtkStyle  *previous_style)
+{
+  if (GTK_WIDGET_CLASS (os_thumb_parent_class)->style_set != NULL)
+    GTK_WIDGET_CLASS (os_thumb_parent_class)->style_set (widget, previous_style);
+
+  /* Render the new theme before the thumb is shown again. */
+  queue_render (OS_THUMB (widget));
+}
+
 static void
 os_thumb_unmap (GtkWidget *widget)
 {
@@ -1059,9 +1383,37 @@ os_thumb_unmap (GtkWidget *widget)
   if (priv->grabbed_widget != NULL && gtk_widget_get_mapped (priv->grabbed_widget))
     gtk_grab_add (priv->grabbed_widget);
 
+  /* Keep the window mapped and park it off-screen,
+   * so the next show only costs a move. */
+  if (gtk_widget_get_realized (widget))
+    {
+      priv->parked = TRUE;
+
+      gtk_widget_set_mapped (widget, FALSE);
+
+      gdk_window_move (gtk_widget_get_window (widget), PARKED_POSITION, PARKED_POSITION);
+
+      return;
+    }
+
   GTK_WIDGET_CLASS (os_thumb_parent_class)->unmap (widget);
 }
 
+static void
+os_thumb_unrealize (GtkWidget *widget)
+{
+  OsThumb *thumb;
+  OsThumbPrivate *priv;
+
+  thumb = OS_THUMB (widget);
+  priv = thumb->priv;
+
+  /* The parked window is going to be destroyed. */
+  priv->parked = FALSE;
+
+  GTK_WIDGET_CLASS (os_thumb_parent_class)->unrealize (widget);
+}
+
 static GObject*
 os_thumb_constructor (GType                  type,
                       guint                  n_construct_properties,
@@ -1086,11 +1438,7 @@ os_thumb_dispose (GObject *object)
   thumb = OS_THUMB (object);
   priv = thumb->priv;
 
-  if (priv->source_id != 0)
-    {
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
-    }
+  os_timer_cancel (&priv->fade_out_timer);
 
   if (priv->animation != NULL)
     {
@@ -1110,6 +1458,20 @@ os_thumb_dispose (GObject *object)
 static void
 os_thumb_finalize (GObject *object)
 {
+  OsThumb *thumb;
+  OsThumbPrivate *priv;
+
+  thumb = OS_THUMB (object);
+  priv = thumb->priv;
+
+  /* Pending renders hold a reference,
+   * so only the published one is left. */
+  if (priv->render != NULL)
+    {
+      render_free (priv->render);
+      priv->render = NULL;
+    }
+
   G_OBJECT_CLASS (os_thumb_parent_class)->finalize (object);
 }
 
@@ -1180,6 +1542,76 @@ os_thumb_new (GtkOrientation orientation)
   return g_object_new (OS_TYPE_THUMB, "orientation", orientation, NULL);
 }
 
+/**
+ * os_thumb_get_position:
+ * @thumb: a #OsThumb
+ * @x: return location for the x coordinate
+ * @y: return location for the y coordinate
+ *
+ * Gets the position of the thumb in root window coordinates,
+ * as set by os_thumb_move (), without asking the X server.
+ **/
+void
+os_thumb_get_position (OsThumb *thumb,
+                       gint    *x,
+                       gint    *y)
+{
+  OsThumbPrivate *priv;
+
+  g_return_if_fail (OS_IS_THUMB (thumb));
+
+  priv = thumb->priv;
+
+  *x = priv->position.x;
+  *y = priv->position.y;
+}
+
+/**
+ * os_thumb_move:
+ * @thumb: a #OsThumb
+ * @x: x coordinate in root window coordinates
+ * @y: y coordinate in root window coordinates
+ *
+ * Moves the thumb. If the thumb is hidden, the position
+ * is stored and applied when it's shown again.
+ **/
+void
+os_thumb_move (OsThumb *thumb,
+               gint     x,
+               gint     y)
+{
+  OsThumbPrivate *priv;
+
+  g_return_if_fail (OS_IS_THUMB (thumb));
+
+  priv = thumb->priv;
+
+  if (gtk_widget_get_mapped (GTK_WIDGET (thumb)))
+    {
+      if (x == priv->position.x && y == priv->position.y)
+        return;
+
+      priv->position.x = x;
+      priv->position.y = y;
+
+      /* The size doesn't change while the thumb follows the pointer,
+       * skip the geometry pass of gtk_window_move () and move the
+       * window directly, os_thumb_resize () syncs the position back. */
+      gdk_window_move (gtk_widget_get_window (GTK_WIDGET (thumb)), x, y);
+
+      return;
+    }
+
+  priv->position.x = x;
+  priv->position.y = y;
+
+  /* A parked thumb is moved back on map. */
+  if (priv->parked)
+    return;
+
+  gtk_window_move (GTK_WINDOW (thumb), x, y);
+}
+
 /**
  * os_thumb_resize:
  * @thumb: a #OsThumb
@@ -1193,8 +1625,17 @@ os_thumb_resize (OsThumb *thumb,
                  gint     width,
                  gint     height)
 {
+  OsThumbPrivate *priv;
+
   g_return_if_fail (OS_IS_THUMB (thumb));
 
+  priv = thumb->priv;
+
+  /* Let GtkWindow know the position set by os_thumb_move (),
+   * or the resize would move the thumb back to a stale one. */
+  if (gtk_widget_get_mapped (GTK_WIDGET (thumb)))
+    gtk_window_move (GTK_WINDOW (thumb), priv->position.x, priv->position.y);
+
   gtk_window_resize (GTK_WINDOW (thumb), width, height);
 }
 
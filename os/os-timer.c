@@ -0,0 +1,341 @@
+/* overlay-scrollbar
+ *
+ * Copyright © 2011 Canonical Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * Authored by Andrea Cimitan <andrea.cimitan@canonical.com>
+ */
+
+#ifndef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "os-private.h"
+
+/* Duration of a tick of the wheel in microseconds. */
+#define WHEEL_TICK 4000
+
+/* Number of slots of each level of the wheel, as a power of two.
+ * The first level spans 256 ms, the second one 16 s. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+
+/* Longest delay, in ticks, the wheel can hold,
+ * later deadlines are parked in the farthest slot and cascaded again. */
+#define WHEEL_SPAN (WHEEL_SIZE * WHEEL_SIZE - 1)
+
+typedef struct
+{
+  GQueue near[WHEEL_SIZE]; /* Timers expiring in the next WHEEL_SIZE ticks. */
+  GQueue far[WHEEL_SIZE]; /* Timers expiring later, by block of WHEEL_SIZE ticks. */
+  GSource *source;
+  gint64 tick; /* Last tick processed. */
+  gint64 next_tick; /* Tick the source is armed for. */
+  guint n_timers;
+  gboolean advancing; /* The expired timers are being fired. */
+} OsTimerWheel;
+
+static OsTimerWheel wheel;
+
+/* Get the current tick. */
+static gint64
+get_current_tick (void)
+{
+  return g_get_monotonic_time () / WHEEL_TICK;
+}
+
+/* Link a timer in the slot matching its expiration,
+ * relative to the last tick processed. */
+static void
+wheel_add (OsTimer *timer)
+{
+  gint64 expire;
+  GQueue *slot;
+
+  expire = MIN (timer->expire_tick, wheel.tick + WHEEL_SPAN);
+
+  if (expire - wheel.tick < WHEEL_SIZE)
+    slot = &wheel.near[expire & WHEEL_MASK];
+  else
+    slot = &wheel.far[(expire >> WHEEL_BITS) & WHEEL_MASK];
+
+  timer->slot = slot;
+
+  g_queue_push_tail_link (slot, &timer->link);
+}
+
+/* Unlink a timer from its slot. */
+static void
+wheel_remove (OsTimer *timer)
+{
+  g_queue_unlink (timer->slot, &timer->link);
+
+  timer->slot = NULL;
+}
+
+/* Find the tick of the earliest deadline.
+ * A first level timer is the earliest one,
+ * otherwise wake up at the next cascade. */
+static gint64
+wheel_get_next_tick (void)
+{
+  gint64 tick;
+
+  if (wheel.n_timers == 0)
+    return G_MAXINT64;
+
+  for (tick = wheel.tick + 1; (tick & WHEEL_MASK) != 0; tick++)
+    {
+      if (!g_queue_is_empty (&wheel.near[tick & WHEEL_MASK]))
+        return tick;
+    }
+
+  return tick;
+}
+
+/* Move the timers of the second level slot reached by the wheel
+ * to the first level. */
+static void
+wheel_cascade (void)
+{
+  GQueue *slot;
+  GQueue cascade;
+
+  slot = &wheel.far[(wheel.tick >> WHEEL_BITS) & WHEEL_MASK];
+
+  /* Swap the slot out first, wheel_add () might put
+   * a timer parked beyond the span back in it. */
+  cascade = *slot;
+  g_queue_init (slot);
+
+  while (!g_queue_is_empty (&cascade))
+    {
+      OsTimer *timer;
+
+      timer = cascade.head->data;
+
+      g_queue_unlink (&cascade, &timer->link);
+      wheel_add (timer);
+    }
+}
+
+/* Advance the wheel up to the given tick, firing the expired timers. */
+static void
+wheel_advance (gint64 current_tick)
+{
+  wheel.advancing = TRUE;
+
+  while (wheel.tick < current_tick)
+    {
+      GQueue *slot;
+
+      /* Nothing to fire, jump straight to the current tick. */
+      if (wheel.n_timers == 0)
+        {
+          wheel.tick = current_tick;
+          break;
+        }
+
+      wheel.tick++;
+
+      if ((wheel.tick & WHEEL_MASK) == 0)
+        wheel_cascade ();
+
+      slot = &wheel.near[wheel.tick & WHEEL_MASK];
+
+      /* Callbacks might cancel or schedule other timers,
+       * always pop the head of the slot.
+       * A timer rescheduled from its own callback lands
+       * at least one tick ahead, so this loop ends. */
+      while (!g_queue_is_empty (slot))
+        {
+          OsTimer *timer;
+
+          timer = slot->head->data;
+
+          os_timer_cancel (timer);
+          timer->func (timer->user_data);
+        }
+    }
+
+  wheel.advancing = FALSE;
+}
+
+/* Arm the source for the earliest deadline. */
+static void
+wheel_update_next_tick (void)
+{
+  wheel.next_tick = wheel_get_next_tick ();
+}
+
+static gboolean
+wheel_source_prepare (GSource *source,
+                      gint    *timeout)
+{
+  gint64 current_time;
+
+  if (wheel.n_timers == 0)
+    {
+      *timeout = -1;
+      return FALSE;
+    }
+
+  current_time = g_get_monotonic_time ();
+
+  if (current_time >= wheel.next_tick * WHEEL_TICK)
+    {
+      *timeout = 0;
+      return TRUE;
+    }
+
+  /* Round up, to not wake up before the deadline. */
+  *timeout = (wheel.next_tick * WHEEL_TICK - current_time + 999) / 1000;
+
+  return FALSE;
+}
+
+static gboolean
+wheel_source_check (GSource *source)
+{
+  return wheel.n_timers > 0 &&
+         get_current_tick () >= wheel.next_tick;
+}
+
+static gboolean
+wheel_source_dispatch (GSource    *source,
+                       GSourceFunc callback,
+                       gpointer    user_data)
+{
+  wheel_advance (get_current_tick ());
+  wheel_update_next_tick ();
+
+  return TRUE;
+}
+
+static GSourceFuncs wheel_source_funcs =
+{
+  wheel_source_prepare,
+  wheel_source_check,
+  wheel_source_dispatch,
+  NULL
+};
+
+/* Public functions. */
+
+/**
+ * os_timer_init:
+ * @timer: a #OsTimer
+ * @func: function to call when the timer expires
+ * @user_data: pointer to the user data
+ *
+ * Initializes @timer, not scheduled
+ **/
+void
+os_timer_init (OsTimer    *timer,
+               OsTimerFunc func,
+               gpointer    user_data)
+{
+  timer->link.data = timer;
+  timer->link.prev = NULL;
+  timer->link.next = NULL;
+  timer->slot = NULL;
+  timer->func = func;
+  timer->user_data = user_data;
+  timer->expire_tick = 0;
+}
+
+/**
+ * os_timer_schedule:
+ * @timer: a #OsTimer
+ * @timeout: delay in milliseconds
+ *
+ * Schedules @timer to fire once after @timeout,
+ * if it's already scheduled it's just moved to its new slot
+ **/
+void
+os_timer_schedule (OsTimer *timer,
+                   guint    timeout)
+{
+  gint64 current_time;
+
+  if (wheel.source == NULL)
+    {
+      guint i;
+
+      for (i = 0; i < WHEEL_SIZE; i++)
+        {
+          g_queue_init (&wheel.near[i]);
+          g_queue_init (&wheel.far[i]);
+        }
+
+      wheel.source = g_source_new (&wheel_source_funcs, sizeof (GSource));
+      g_source_set_priority (wheel.source, G_PRIORITY_DEFAULT);
+      g_source_attach (wheel.source, NULL);
+    }
+
+  current_time = g_get_monotonic_time ();
+
+  if (timer->slot != NULL)
+    {
+      wheel_remove (timer);
+      wheel.n_timers--;
+    }
+
+  /* An empty wheel doesn't need to catch up,
+   * unless it's firing timers, the slot being processed must not move. */
+  if (wheel.n_timers == 0 && !wheel.advancing)
+    wheel.tick = current_time / WHEEL_TICK;
+
+  /* Round up, to not fire before the deadline,
+   * and never in the slot being processed. */
+  timer->expire_tick = (current_time + (gint64) timeout * 1000 + WHEEL_TICK - 1) / WHEEL_TICK;
+  timer->expire_tick = MAX (timer->expire_tick, wheel.tick + 1);
+
+  wheel_add (timer);
+  wheel.n_timers++;
+
+  if (wheel.n_timers == 1 || timer->expire_tick < wheel.next_tick)
+    wheel_update_next_tick ();
+}
+
+/**
+ * os_timer_cancel:
+ * @timer: a #OsTimer
+ *
+ * Cancels @timer, if it's scheduled
+ **/
+void
+os_timer_cancel (OsTimer *timer)
+{
+  if (timer->slot == NULL)
+    return;
+
+  wheel_remove (timer);
+  wheel.n_timers--;
+}
+
+/**
+ * os_timer_is_pending:
+ * @timer: a #OsTimer
+ *
+ * Returns: TRUE if @timer is scheduled
+ **/
+gboolean
+os_timer_is_pending (OsTimer *timer)
+{
+  return timer->slot != NULL;
+}
@@ -0,0 +1,365 @@
+/* overlay-scrollbar
+ *
+ * Copyright © 2011 Canonical Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * Authored by Andrea Cimitan <andrea.cimitan@canonical.com>
+ */
+
+/* Run with GTK_MODULES=overlay-scrollbar, optionally passing
+ * the name of a single benchmark to run. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+
+/* Number of pointer motions of the motion benchmark. */
+#define MOTION_EVENTS 2000
+
+/* Distance in pixels of the pointer from the scrollbar,
+ * inside the proximity area but outside the thumb. */
+#define MOTION_OFFSET 30
+
+/* Columns and rows of scrollbars of the proximity benchmark. */
+#define PROXIMITY_COLUMNS 25
+#define PROXIMITY_ROWS 20
+
+/* Scrollbars and columns of scrollbars of the teardown benchmark. */
+#define TEARDOWN_SCROLLBARS 10000
+#define TEARDOWN_COLUMNS 100
+
+typedef struct
+{
+  const gchar *name;
+  void (* run) (void);
+}
+Benchmark;
+
+static void benchmark_edge (void);
+static void benchmark_motion (void);
+static void benchmark_proximity (void);
+static void benchmark_teardown (void);
+
+static Benchmark benchmarks[] =
+{
+  { "motion", benchmark_motion },
+  { "edge", benchmark_edge },
+  { "proximity", benchmark_proximity },
+  { "teardown", benchmark_teardown },
+};
+
+/**
+ * flush_events:
+ * wait for the X server and dispatch every pending event
+ **/
+static void
+flush_events (void)
+{
+  gdk_display_sync (gdk_display_get_default ());
+
+  while (gtk_events_pending ())
+    gtk_main_iteration ();
+}
+
+/**
+ * run_motion:
+ * warp the pointer through a rectangle in root coordinates,
+ * reporting the motion events per second handled
+ **/
+static void
+run_motion (const gchar *name,
+            gint         x,
+            gint         y,
+            gint         width,
+            gint         height)
+{
+  GdkDisplay *display;
+  GdkScreen *screen;
+  gint64 start_time, elapsed;
+  gint i;
+
+  display = gdk_display_get_default ();
+  screen = gdk_display_get_default_screen (display);
+
+  start_time = g_get_monotonic_time ();
+
+  for (i = 0; i < MOTION_EVENTS; i++)
+    {
+      gdk_display_warp_pointer (display, screen,
+                                x + (i * 13) % width,
+                                y + (i * 7) % height);
+      flush_events ();
+    }
+
+  elapsed = g_get_monotonic_time () - start_time;
+
+  g_print ("%s: %d events in %.3f s, %.0f events/s\n",
+           name, MOTION_EVENTS, elapsed / (gdouble) G_USEC_PER_SEC,
+           MOTION_EVENTS * (gdouble) G_USEC_PER_SEC / MAX (elapsed, 1));
+}
+
+/**
+ * window_new_with_text:
+ * create a toplevel with a scrolled text view
+ **/
+static GtkWidget*
+window_new_with_text (GtkWidget **scrolled_window)
+{
+  GtkTextBuffer *text_buffer;
+  GtkWidget *text_view;
+  GtkWidget *window;
+  GString *text;
+  gint i;
+
+  /* window */
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_default_size (GTK_WINDOW (window), 400, 500);
+  gtk_window_set_title (GTK_WINDOW (window), "\"Overlay Scrollbar\" benchmark");
+
+  /* scrolled_window */
+  *scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (*scrolled_window),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+
+  /* text_view */
+  text_view = gtk_text_view_new ();
+  gtk_container_add (GTK_CONTAINER (*scrolled_window), text_view);
+
+  /* text_buffer */
+  text = g_string_new (NULL);
+  for (i = 0; i < 1000; i++)
+    g_string_append (text, "Ubuntu is gonna rock!\n");
+
+  text_buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (text_view));
+  gtk_text_buffer_set_text (text_buffer, text->str, -1);
+  g_string_free (text, TRUE);
+
+  gtk_container_add (GTK_CONTAINER (window), *scrolled_window);
+
+  gtk_widget_show_all (window);
+  flush_events ();
+
+  return window;
+}
+
+/**
+ * move_to_edge:
+ * move the window against the right edge of its monitor
+ **/
+static void
+move_to_edge (GtkWidget *window)
+{
+  GdkRectangle monitor;
+  GdkScreen *screen;
+  gint width, height;
+
+  screen = gtk_widget_get_screen (window);
+
+  gdk_screen_get_monitor_geometry (screen,
+                                   gdk_screen_get_monitor_at_window (screen, gtk_widget_get_window (window)),
+                                   &monitor);
+  gtk_window_get_size (GTK_WINDOW (window), &width, &height);
+  gtk_window_move (GTK_WINDOW (window), monitor.x + monitor.width - width, monitor.y);
+  flush_events ();
+}
+
+/**
+ * run_thumb_motion:
+ * create a window with a scrolled text view, optionally placed
+ * by place_window, and measure the pointer motions per second handled
+ * in the proximity area, where every motion moves the thumb
+ **/
+static void
+run_thumb_motion (const gchar *name,
+                  void       (*place_window) (GtkWidget *window))
+{
+  GdkDisplay *display;
+  GdkScreen *screen;
+  GtkAllocation allocation;
+  GtkWidget *scrolled_window;
+  GtkWidget *scrollbar;
+  GtkWidget *window;
+  gint x, y;
+
+  display = gdk_display_get_default ();
+  screen = gdk_display_get_default_screen (display);
+
+  window = window_new_with_text (&scrolled_window);
+
+  if (place_window != NULL)
+    place_window (window);
+
+  scrollbar = gtk_scrolled_window_get_vscrollbar (GTK_SCROLLED_WINDOW (scrolled_window));
+  gtk_widget_get_allocation (scrollbar, &allocation);
+  gdk_window_get_origin (gtk_widget_get_window (scrollbar), &x, &y);
+
+  x += allocation.x + allocation.width - MOTION_OFFSET;
+  y += allocation.y;
+
+  /* Enter the proximity area and wait for the thumb to show. */
+  gdk_display_warp_pointer (display, screen, x, y + allocation.height / 2);
+  flush_events ();
+  g_usleep (G_USEC_PER_SEC / 2);
+  flush_events ();
+
+  run_motion (name, x, y, 1, allocation.height);
+
+  gtk_widget_destroy (window);
+  flush_events ();
+}
+
+/**
+ * benchmark_motion:
+ * measure the pointer motions per second handled in the proximity area,
+ * where every motion moves the thumb
+ **/
+static void
+benchmark_motion (void)
+{
+  run_thumb_motion ("motion", NULL);
+}
+
+/**
+ * benchmark_edge:
+ * measure the pointer motions per second handled in the proximity area
+ * of a window touching the right edge of its monitor,
+ * where every motion clamps the thumb against the monitor edge
+ **/
+static void
+benchmark_edge (void)
+{
+  run_thumb_motion ("edge", move_to_edge);
+}
+
+/**
+ * benchmark_proximity:
+ * measure the pointer motions per second handled
+ * in a window with PROXIMITY_COLUMNS * PROXIMITY_ROWS scrollbars
+ **/
+static void
+benchmark_proximity (void)
+{
+  GtkWidget *fixed;
+  GtkWidget *window;
+  gint x, y;
+  gint i;
+
+  /* window */
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_title (GTK_WINDOW (window), "\"Overlay Scrollbar\" proximity benchmark");
+
+  /* fixed */
+  fixed = gtk_fixed_new ();
+  gtk_widget_set_size_request (fixed, PROXIMITY_COLUMNS * 40, PROXIMITY_ROWS * 45);
+  gtk_container_add (GTK_CONTAINER (window), fixed);
+
+  /* scrollbars */
+  for (i = 0; i < PROXIMITY_COLUMNS * PROXIMITY_ROWS; i++)
+    {
+      GtkObject *adjustment;
+      GtkWidget *scrollbar;
+
+      adjustment = gtk_adjustment_new (0, 0, 100, 1, 10, 10);
+      scrollbar = gtk_vscrollbar_new (GTK_ADJUSTMENT (adjustment));
+      gtk_widget_set_size_request (scrollbar, -1, 40);
+
+      gtk_fixed_put (GTK_FIXED (fixed), scrollbar,
+                     (i % PROXIMITY_COLUMNS) * 40 + 39,
+                     (i / PROXIMITY_COLUMNS) * 45);
+    }
+
+  gtk_widget_show_all (window);
+  flush_events ();
+
+  gdk_window_get_origin (gtk_widget_get_window (fixed), &x, &y);
+
+  run_motion ("proximity", x, y, PROXIMITY_COLUMNS * 40, PROXIMITY_ROWS * 45);
+
+  gtk_widget_destroy (window);
+  flush_events ();
+}
+
+/**
+ * benchmark_teardown:
+ * measure the time spent destroying a window
+ * with TEARDOWN_SCROLLBARS mapped scrollbars
+ **/
+static void
+benchmark_teardown (void)
+{
+  GtkWidget *fixed;
+  GtkWidget *window;
+  gint64 start_time, elapsed;
+  gint i;
+
+  /* window */
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_title (GTK_WINDOW (window), "\"Overlay Scrollbar\" teardown benchmark");
+
+  /* fixed */
+  fixed = gtk_fixed_new ();
+  gtk_container_add (GTK_CONTAINER (window), fixed);
+
+  /* scrollbars */
+  for (i = 0; i < TEARDOWN_SCROLLBARS; i++)
+    {
+      GtkObject *adjustment;
+      GtkWidget *scrollbar;
+
+      adjustment = gtk_adjustment_new (0, 0, 100, 1, 10, 10);
+      scrollbar = gtk_vscrollbar_new (GTK_ADJUSTMENT (adjustment));
+      gtk_widget_set_size_request (scrollbar, -1, 40);
+
+      gtk_fixed_put (GTK_FIXED (fixed), scrollbar,
+                     (i % TEARDOWN_COLUMNS) * 10 + 9,
+                     (i / TEARDOWN_COLUMNS) * 45);
+    }
+
+  gtk_widget_show_all (window);
+  flush_events ();
+
+  start_time = g_get_monotonic_time ();
+
+  gtk_widget_destroy (window);
+  flush_events ();
+
+  elapsed = g_get_monotonic_time () - start_time;
+
+  g_print ("teardown: %d scrollbars in %.3f s\n",
+           TEARDOWN_SCROLLBARS, elapsed / (gdouble) G_USEC_PER_SEC);
+}
+
+/**
+ * main:
+ * main routine
+ **/
+int
+main (int   argc,
+      char *argv[])
+{
+  guint i;
+
+  gtk_init (&argc, &argv);
+
+  for (i = 0; i < G_N_ELEMENTS (benchmarks); i++)
+    {
+      if (argc > 1 && strcmp (argv[1], benchmarks[i].name) != 0)
+        continue;
+
+      benchmarks[i].run ();
+    }
+
+  return 0;
+}